@@ -0,0 +1,96 @@
+/*
+ * File:   background.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#include "background.h"
+#include "initialise.h"
+#include "scheduler.h"
+#include "timestamp.h"
+
+typedef struct {
+    background_fn fn;       // 0 when the entry is free
+    void * arg;
+    uint32_t counts;        // declared chunk cost, Timer 1 counts (0 = measure)
+    uint32_t max;           // longest chunk seen, core timer cycles
+} background_job;
+
+static background_job jobs[BACKGROUND_MAX_JOBS];
+static uint32_t next_job = 0;   // round robin
+static uint32_t num_jobs = 0;
+static uint32_t chunks = 0;
+
+uint32_t background_add(background_fn fn, void * arg, uint32_t counts){
+    /* Returns the entry used. Too many jobs is a configuration fault. */
+    uint32_t j;
+    if (fn == 0){
+        fatal_error("Bad background job.", 0);
+    }
+    for (j = 0; j < BACKGROUND_MAX_JOBS; j++){
+        if (jobs[j].fn == 0){
+            jobs[j].arg = arg;
+            jobs[j].counts = counts;
+            jobs[j].max = 0;
+            jobs[j].fn = fn;
+            num_jobs++;
+            return j;
+        }
+    }
+    fatal_error("Background jobs full.", BACKGROUND_MAX_JOBS);
+    return 0;
+}
+
+static uint32_t chunk_cost(const background_job * b){
+    if (b->counts){
+        return b->counts;
+    }
+    if (b->max){
+        return timestamp_to_tick_counts(b->max);
+    }
+    return BACKGROUND_FIRST_GUESS;
+}
+
+void background_run(void){
+    /* One chunk of the next job, if it fits before the tick. A job that does
+     * not fit now lets the next one try on the next call. */
+    background_job * b;
+    uint32_t n, start, t;
+    if (num_jobs == 0){
+        return;
+    }
+    for (n = 0; n < BACKGROUND_MAX_JOBS; n++){
+        b = &jobs[next_job];
+        next_job = (next_job + 1) % BACKGROUND_MAX_JOBS;
+        if (b->fn){
+            break;
+        }
+    }
+    if (scheduler_time_remaining() < chunk_cost(b) + BACKGROUND_MARGIN){
+        return;
+    }
+    start = timestamp_now32();
+    n = b->fn(b->arg);
+    t = timestamp_now32() - start;
+    chunks++;
+    if (t > b->max){
+        b->max = t;
+        if (timestamp_to_tick_counts(t) > SYSTEM_TICK_TIMER){
+            fatal_error("Background chunk too long.", b - jobs);
+        }
+    }
+    if (n == 0){
+        b->fn = 0;
+        num_jobs--;
+    }
+}
+
+uint32_t background_pending(void){
+    return num_jobs;
+}
+
+uint32_t background_chunks(void){
+    return chunks;
+}
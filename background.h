@@ -0,0 +1,43 @@
+/*
+ * File:   background.h
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#ifndef _BACKGROUND_H
+#define _BACKGROUND_H
+
+#include "hal.h"
+
+/* Background jobs: long work (checksums, filter design, compaction ...) cut
+ * into chunks and run in the dead time between ticks. background_run() is
+ * called from the main loop and runs one chunk, of the jobs in turn, only
+ * if scheduler_time_remaining() says it will be done before the next Timer
+ * 1 tick. So a job never makes a tick late, it just takes the CPU share the
+ * tasks leave.
+ *
+ * A job is a function that does one chunk of work on each call and returns
+ * non zero while there is more to do, 0 when it is finished. Its chunk cost
+ * is declared in Timer 1 counts, or given as 0 to use the longest chunk
+ * seen so far. A chunk must fit well inside a tick: one seen to take longer
+ * is a fatal error. Jobs are added from main or tasks, not ISR's. */
+
+// at most this many jobs at once
+#define BACKGROUND_MAX_JOBS 8
+
+// Timer 1 counts kept spare before the tick, for the rest of the main loop
+#define BACKGROUND_MARGIN 75
+
+// the cost assumed for a job's first chunk, when it has no declared cost
+#define BACKGROUND_FIRST_GUESS (SYSTEM_TICK_TIMER / 2)
+
+typedef uint32_t (*background_fn)(void * arg);
+
+uint32_t background_add(background_fn fn, void * arg, uint32_t counts);
+void background_run(void);
+uint32_t background_pending(void);
+uint32_t background_chunks(void);
+
+#endif // _BACKGROUND_H
@@ -0,0 +1,138 @@
+/*
+ * File:   clock_config.h
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#ifndef _CLOCK_CONFIG_H
+#define _CLOCK_CONFIG_H
+
+#include <stdint.h>
+
+/* Clock and timing configuration. Set the clocks, the tick periods and the
+ * debug baud rate here; the timer prescaler, PR1, PR3, U1BRG, flash wait
+ * states and the core timer rate are all worked out from them at compile
+ * time. The build fails if a tick or the baud rate cannot be made within
+ * tolerance. main.c sets the PLL from SYSCLK_HZ (48 or 80MHz, from the 8MHz
+ * crystal) and the peripheral bus divider from PBCLK_HZ.
+ *
+ * 80MHz gives 67% more CPU per tick, and 921.6k is still within 1.4%:
+ *   #define SYSCLK_HZ 80000000UL
+ *   #define PBCLK_HZ  80000000UL
+ */
+
+// --- INPUTS ---
+
+#ifndef SYSCLK_HZ
+#define SYSCLK_HZ       48000000UL
+#endif
+#ifndef PBCLK_HZ
+#define PBCLK_HZ        SYSCLK_HZ
+#endif
+
+#define TICK_US         5000        // scheduler tick, Timer 1
+#define FAST_TICK_US    1000        // fast tier tick, Timer 3
+#define DEBUG_BAUD      921600UL    // UART 1, 8N1
+
+// largest error allowed, parts per million
+#define TICK_TOLERANCE_PPM  1000
+#define BAUD_TOLERANCE_PPM  20000
+
+// The tick timers use the smallest prescaler (1, 8, 64 or 256; all three
+// timers alike) that keeps a tick within this many counts. That leaves the
+// tickless idle room to stretch a Timer 1 period over 8 ticks or more, and
+// the count, the unit of task WCET's, around a microsecond.
+#define TICK_COUNTS_MAX 8192
+
+// --- DERIVED ---
+
+// counts in a tick at prescale p, rounded
+#define CLOCK_COUNTS_(p, us) ((PBCLK_HZ * 1ULL * (us) / (p) + 500000) / 1000000)
+
+#define TICK_PRESCALE \
+    (CLOCK_COUNTS_(1, TICK_US) <= TICK_COUNTS_MAX ? 1 : \
+     CLOCK_COUNTS_(8, TICK_US) <= TICK_COUNTS_MAX ? 8 : \
+     CLOCK_COUNTS_(64, TICK_US) <= TICK_COUNTS_MAX ? 64 : 256)
+
+// TCKPS field values for that prescaler: Timer 1 (type A), Timer 3 (type B)
+#define TICK_T1_TCKPS \
+    (TICK_PRESCALE == 1 ? 0 : TICK_PRESCALE == 8 ? 1 : TICK_PRESCALE == 64 ? 2 : 3)
+#define TICK_T23_TCKPS \
+    (TICK_PRESCALE == 1 ? 0 : TICK_PRESCALE == 8 ? 3 : TICK_PRESCALE == 64 ? 6 : 7)
+
+// Timer 2, the software timers (swtimer.c): 1:8 for sub microsecond counts,
+// up to 10.9ms a shot @ 48MHz
+#define SWTIMER_PRESCALE    8
+#define SWTIMER_T2_TCKPS    3
+#define SWTIMER_HZ          (PBCLK_HZ / SWTIMER_PRESCALE)
+
+#define TICK_COUNTS_        CLOCK_COUNTS_(TICK_PRESCALE, TICK_US)
+#define FAST_TICK_COUNTS_   CLOCK_COUNTS_(TICK_PRESCALE, FAST_TICK_US)
+
+// value of PR1, the timer counts 0..PR1
+#define SYSTEM_TICK_TIMER   ((uint32_t)(TICK_COUNTS_ - 1))
+#define SYSTEM_TICKS_PER_SEC (1000000 / TICK_US)
+// value of PR3
+#define FAST_TICK_TIMER     ((uint32_t)(FAST_TICK_COUNTS_ - 1))
+#define FAST_TICKS_PER_SEC  (1000000 / FAST_TICK_US)
+// Timer 1 count rate
+#define TICK_TIMER_HZ       (PBCLK_HZ / TICK_PRESCALE)
+
+// U1BRG with BRGH = 1 (4 clocks per bit), rounded, and the rate it gives
+#define DEBUG_BRG_          ((PBCLK_HZ + 2 * DEBUG_BAUD) / (4 * DEBUG_BAUD) - 1)
+#define DEBUG_UART_BRG      ((uint32_t)DEBUG_BRG_)
+#define DEBUG_BAUD_ACTUAL   (PBCLK_HZ / (4 * (DEBUG_BRG_ + 1)))
+
+// CP0 Count (hal_core_timer()) runs at SYSCLK / 2
+#define CORE_TIMER_HZ       (SYSCLK_HZ / 2)
+
+// program flash wait states, one per 30MHz
+#define FLASH_WAIT_STATES   ((SYSCLK_HZ - 1) / 30000000UL)
+
+// --- CHECKS ---
+
+#if SYSCLK_HZ > 80000000UL
+#error "SYSCLK_HZ over the 80MHz the part is rated for"
+#endif
+#if PBCLK_HZ != SYSCLK_HZ && PBCLK_HZ * 2 != SYSCLK_HZ && PBCLK_HZ * 4 != SYSCLK_HZ \
+        && PBCLK_HZ * 8 != SYSCLK_HZ
+#error "PBCLK_HZ must be SYSCLK_HZ / 1, 2, 4 or 8"
+#endif
+#if 1000000 % TICK_US != 0 || 1000000 % FAST_TICK_US != 0
+#error "TICK_US and FAST_TICK_US must divide a second"
+#endif
+#if PBCLK_HZ % TICK_PRESCALE != 0 || SYSCLK_HZ / 2 % (PBCLK_HZ / TICK_PRESCALE) != 0
+#error "Timer 1 count rate must divide the core timer rate"
+#endif
+#if PBCLK_HZ % SWTIMER_PRESCALE != 0 || SYSCLK_HZ / 2 % (PBCLK_HZ / SWTIMER_PRESCALE) != 0
+#error "Timer 2 count rate must divide the core timer rate"
+#endif
+#if TICK_COUNTS_ > 65536 || FAST_TICK_COUNTS_ > 65536
+#error "tick too long for a 16 bit timer"
+#endif
+#if FAST_TICK_COUNTS_ < 16
+#error "fast tick too short for the timer resolution"
+#endif
+#if (TICK_COUNTS_ * TICK_PRESCALE * 1000000 > PBCLK_HZ * 1ULL * TICK_US \
+        ? TICK_COUNTS_ * TICK_PRESCALE * 1000000 - PBCLK_HZ * 1ULL * TICK_US \
+        : PBCLK_HZ * 1ULL * TICK_US - TICK_COUNTS_ * TICK_PRESCALE * 1000000) \
+        * 1000000 > PBCLK_HZ * 1ULL * TICK_US * TICK_TOLERANCE_PPM
+#error "scheduler tick error over TICK_TOLERANCE_PPM"
+#endif
+#if (FAST_TICK_COUNTS_ * TICK_PRESCALE * 1000000 > PBCLK_HZ * 1ULL * FAST_TICK_US \
+        ? FAST_TICK_COUNTS_ * TICK_PRESCALE * 1000000 - PBCLK_HZ * 1ULL * FAST_TICK_US \
+        : PBCLK_HZ * 1ULL * FAST_TICK_US - FAST_TICK_COUNTS_ * TICK_PRESCALE * 1000000) \
+        * 1000000 > PBCLK_HZ * 1ULL * FAST_TICK_US * TICK_TOLERANCE_PPM
+#error "fast tick error over TICK_TOLERANCE_PPM"
+#endif
+#if DEBUG_BRG_ > 65535
+#error "DEBUG_BAUD too low for U1BRG"
+#endif
+#if (DEBUG_BAUD_ACTUAL > DEBUG_BAUD ? DEBUG_BAUD_ACTUAL - DEBUG_BAUD : DEBUG_BAUD - DEBUG_BAUD_ACTUAL) \
+        * 1000000 > DEBUG_BAUD * BAUD_TOLERANCE_PPM
+#error "debug baud rate error over BAUD_TOLERANCE_PPM"
+#endif
+
+#endif // _CLOCK_CONFIG_H
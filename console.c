@@ -0,0 +1,300 @@
+/*
+ * File:   console.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#include <string.h>
+
+#include "console.h"
+#include "initialise.h"
+#include "scheduler.h"
+#include "background.h"
+#include "debug_uart.h"
+#include "debug_log.h"
+#include "queue.h"
+#include "stack.h"
+#include "swtimer.h"
+#include "timestamp.h"
+#include "trace.h"
+#include "xprintf.h"
+
+#ifdef DEBUG_CONSOLE
+
+SPSC_QUEUE(console_rx, uint8_t, CONSOLE_RX_QUEUE);
+
+static task_handle console_event;
+static volatile uint32_t rx_overruns = 0;
+
+static char line[CONSOLE_LINE_MAX + 1];
+static uint32_t line_len = 0;           // CONSOLE_LINE_MAX + 1: too long
+
+// a command prints reply line n of its reply, and returns non zero while
+// there are more
+typedef struct {
+    const char * name;
+    const char * usage;
+    uint32_t args;
+    uint32_t (*reply)(uint32_t n);
+} console_cmd;
+
+static const console_cmd * command = 0;     // replying, until its job is done
+static uint32_t reply_line;
+static uint32_t arg[2];
+static const char * error_msg;
+
+// --- COMMANDS ---
+
+static uint32_t cmd_help(uint32_t n);
+
+static uint32_t cmd_tasks(uint32_t n){
+    /* Two lines per task: T<id> period misses, and its P line */
+    static uint32_t t;
+    if (n == 0){
+        t = 0;
+    }
+    while (t < scheduler_num_tasks() && !scheduler_task_active(t)){
+        t++;
+    }
+    if (t >= scheduler_num_tasks()){
+        if (n == 0){
+            xprintf("no tasks\r\n");
+        }
+        return 0;
+    }
+    if ((n & 1) == 0){
+        xprintf("T%u period %u misses %u\r\n", t, scheduler_task_period(t),
+                scheduler_task_misses(t));
+        return 1;
+    }
+#ifdef PROFILE_TASKS
+    profile_print(t, scheduler_task_profile(t));
+#endif
+    t++;
+    return 1;
+}
+
+static uint32_t cmd_load(uint32_t n){
+    uint32_t max = scheduler_tick_max();
+    (void)n;
+    xprintf("load max %u/%u counts %u%% %u us, %u overruns\r\n",
+            max, SYSTEM_TICK_TIMER + 1, max * 100 / (SYSTEM_TICK_TIMER + 1),
+            (uint32_t)timestamp_to_us(scheduler_busy_max(0)), scheduler_overruns());
+    return 0;
+}
+
+static uint32_t cmd_drops(uint32_t n){
+    (void)n;
+    xprintf("drops print %u (%u chars) log %u trace %u console %u swtimer %u\r\n",
+            debug_print_dropped(), debug_print_overflow(), debug_log_dropped(),
+            trace_lost(), console_dropped(), swtimer_missed());
+    return 0;
+}
+
+static uint32_t cmd_stack(uint32_t n){
+    ram_stats s;
+    (void)n;
+    stack_ram_stats(&s);
+    xprintf("stack %u of %u bytes, static %u, ram %u\r\n",
+            s.stack_used, s.stack, s.static_ram, s.ram);
+    return 0;
+}
+
+static uint32_t cmd_reset(uint32_t n){
+    (void)n;
+    scheduler_stats_reset();
+    xprintf("reset\r\n");
+    return 0;
+}
+
+static uint32_t cmd_period(uint32_t n){
+    /* Only a periodic task, and a period the scheduler takes, as a bad one
+     * would be fatal. */
+    (void)n;
+    if (scheduler_task_period(arg[0]) == 0){
+        xprintf("? no periodic task %u\r\n", arg[0]);
+    } else if (arg[1] == 0 || arg[1] > 0x7FFFFFFF){
+        xprintf("? bad period %u\r\n", arg[1]);
+    } else {
+        scheduler_set_period(arg[0], arg[1]);
+        xprintf("T%u period %u\r\n", arg[0], arg[1]);
+    }
+    return 0;
+}
+
+static uint32_t cmd_error(uint32_t n){
+    (void)n;
+    xprintf("? %s, try help\r\n", error_msg);
+    return 0;
+}
+
+static const console_cmd commands[] = {
+    { "help",   "",                 0, cmd_help },
+    { "tasks",  "",                 0, cmd_tasks },
+    { "load",   "",                 0, cmd_load },
+    { "drops",  "",                 0, cmd_drops },
+    { "stack",  "",                 0, cmd_stack },
+    { "reset",  "",                 0, cmd_reset },
+    { "period", " <task> <ticks>",  2, cmd_period },
+};
+#define NUM_COMMANDS (sizeof commands / sizeof commands[0])
+
+static const console_cmd error_cmd = { "", "", 0, cmd_error };
+
+static uint32_t cmd_help(uint32_t n){
+    xprintf("%s%s\r\n", commands[n].name, commands[n].usage);
+    return n + 1 < NUM_COMMANDS;
+}
+
+// --- REPLY AND PARSER ---
+
+static uint32_t job_reply(void * a){
+    /* A background job: the next line of the reply, once there is room for
+     * it. Then the parser can go on to the next command. */
+    (void)a;
+    if (debug_print_free() < CONSOLE_REPLY_ROOM){
+        return 1;
+    }
+    if (command->reply(reply_line++)){
+        return 1;
+    }
+    command = 0;
+    scheduler_post_event(console_event);
+    return 0;
+}
+
+static void reply(const console_cmd * c){
+    command = c;
+    reply_line = 0;
+    background_add(job_reply, 0, 0);
+}
+
+static uint32_t parse_number(const char * s, uint32_t * v){
+    uint32_t n = 0;
+    if (*s == 0){
+        return 0;
+    }
+    for (; *s; s++){
+        if (*s < '0' || *s > '9' || n > 0xFFFFFFFF / 10 - 1){
+            return 0;
+        }
+        n = n * 10 + (*s - '0');
+    }
+    *v = n;
+    return 1;
+}
+
+static void run_line(void){
+    /* Split the line at spaces, find the command and check its args */
+    char * word[3];
+    uint32_t words = 0, i;
+    char * p = line;
+    line[line_len] = 0;
+    while (*p && words < 3){
+        while (*p == ' '){
+            *p++ = 0;
+        }
+        if (*p){
+            word[words++] = p;
+        }
+        while (*p && *p != ' '){
+            p++;
+        }
+    }
+    while (*p == ' '){
+        p++;
+    }
+    if (words == 0){
+        return;
+    }
+    if (*p){
+        error_msg = "too many args";
+        reply(&error_cmd);
+        return;
+    }
+    for (i = 0; i < NUM_COMMANDS; i++){
+        if (strcmp(word[0], commands[i].name) == 0){
+            uint32_t a;
+            if (words - 1 != commands[i].args){
+                error_msg = "wrong args";
+                reply(&error_cmd);
+                return;
+            }
+            for (a = 0; a < commands[i].args; a++){
+                if (!parse_number(word[a + 1], &arg[a])){
+                    error_msg = "bad number";
+                    reply(&error_cmd);
+                    return;
+                }
+            }
+            reply(&commands[i]);
+            return;
+        }
+    }
+    error_msg = "unknown command";
+    reply(&error_cmd);
+}
+
+static void task_console(void){
+    /* Event task, posted by the RX ISR at the end of a line, and by the
+     * reply job when it is done. Takes chars up to the end of a line and
+     * starts its command; the rest wait for that to finish. */
+    uint8_t c;
+    while (command == 0 && spsc_get(&console_rx, &c)){
+        if (c == '\r' || c == '\n'){
+            if (line_len > CONSOLE_LINE_MAX){
+                error_msg = "line too long";
+                reply(&error_cmd);
+            } else {
+                run_line();
+            }
+            line_len = 0;
+        } else if (line_len <= CONSOLE_LINE_MAX){
+            if (line_len < CONSOLE_LINE_MAX){
+                line[line_len] = (char)c;
+            }
+            line_len++;
+        }
+    }
+}
+
+void __ISR(_UART_1_VECTOR, IPL1AUTO) Uart1Rx(void){
+    /* Queue what has come in, and have the parser run at the end of a line,
+     * or when the queue is full so it makes room. The flag is cleared
+     * first: a char that lands after the drain sets it again, rather than
+     * waiting in the FIFO for the next one. */
+    trace_event(TRACE_ISR_ENTER, TRACE_ISR_UART1, 0);
+    hal_uart_rx_ack();
+    while (hal_uart_rx_ready()){
+        uint8_t c = hal_uart_rx();
+        if (!spsc_put(&console_rx, &c) || c == '\r' || c == '\n'){
+            scheduler_post_event(console_event);
+        }
+    }
+    if (hal_uart_rx_overrun()){
+        rx_overruns++;
+    }
+    trace_event(TRACE_ISR_EXIT, TRACE_ISR_UART1, 0);
+}
+
+void init_console(void){
+    /* After init_scheduler(), as the parser is an event task */
+    console_event = scheduler_add_event_task(task_console);
+}
+
+uint32_t console_dropped(void){
+    return spsc_full(&console_rx) + rx_overruns;
+}
+
+#else
+
+void init_console(void){
+}
+
+uint32_t console_dropped(void){
+    return 0;
+}
+
+#endif // DEBUG_CONSOLE
@@ -0,0 +1,51 @@
+/*
+ * File:   console.h
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#ifndef _CONSOLE_H
+#define _CONSOLE_H
+
+#include "hal.h"
+
+/* Command console on the receive side of the debug UART, to look into a
+ * running unit without reflashing it. The UART 1 RX ISR (IPL1) only queues
+ * the chars, and at the end of a line posts an event task that parses it in
+ * dead time. The reply is a background job, a line per chunk, so it never
+ * makes a tick late, and each line waits for room in the print buffer
+ * rather than being dropped. There is no echo: turn on local echo in the
+ * terminal. Lines end with CR or LF.
+ *
+ *   help                   list the commands
+ *   tasks                  period, misses and execution time profile (the P
+ *                          line, see profile.h) of each task
+ *   load                   worst tick so far, Timer 1 counts and us, and the
+ *                          overruns
+ *   drops                  debug prints, log records, trace events and
+ *                          console chars lost, software timer periods missed
+ *   stack                  stack high water and static RAM (stack.h)
+ *   reset                  clear the statistics
+ *   period <task> <ticks>  change the period of a task
+ */
+
+// Comment out to leave the UART receiver off, for units in the field that
+// should not take commands.
+#define DEBUG_CONSOLE
+
+// longest command line, longer ones are refused
+#define CONSOLE_LINE_MAX 32
+
+// chars the RX ISR can queue for the parser (2^n)
+#define CONSOLE_RX_QUEUE 64
+
+// print buffer room a reply line waits for
+#define CONSOLE_REPLY_ROOM 160
+
+void init_console(void);
+// chars lost, to a full queue or a UART overrun
+uint32_t console_dropped(void);
+
+#endif // _CONSOLE_H
@@ -0,0 +1,121 @@
+/*
+ * File:   debug_log.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#include "debug_log.h"
+#include "debug_uart.h"
+#include "scheduler.h"
+#include "trace.h"
+#include "xprintf.h"
+
+#define DEBUG_LOG_MASK (DEBUG_LOG_SIZE - 1)
+
+typedef struct {
+    const char * fmt;       // 0 until the record is complete
+    uint32_t tick;          // scheduler_now() when logged
+    uint32_t counts;        // Timer 1 count into that tick
+    uint32_t arg[DEBUG_LOG_ARGS];
+} log_record;
+
+static volatile log_record log_ring[DEBUG_LOG_SIZE];
+static volatile uint32_t log_head = 0;     // next record to reserve, not masked
+static volatile uint32_t log_tail = 0;     // next record to print, not masked
+static volatile uint32_t log_dropped = 0;
+static uint32_t log_reported = 0;          // log_dropped at the last report
+
+void init_debug_log(void){
+    uint32_t i;
+    for (i = 0; i < DEBUG_LOG_SIZE; i++){
+        log_ring[i].fmt = 0;
+    }
+    log_head = 0;
+    log_tail = 0;
+    log_dropped = 0;
+    log_reported = 0;
+}
+
+void debug_log_put(const char * fmt, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3){
+    /* Reserve a record with compare and swap (LL/SC on the M4K), so a
+     * higher level ISR can log in the middle of this. The record is only
+     * handed to the drain when fmt is written, last. */
+    volatile log_record * r;
+    uint32_t h;
+    do {
+        h = log_head;
+        if (h - log_tail >= DEBUG_LOG_SIZE){
+            __sync_fetch_and_add(&log_dropped, 1);
+            return; // ring is full
+        }
+    } while (!__sync_bool_compare_and_swap(&log_head, h, h + 1));
+    trace_event(TRACE_LOG, 0, h);
+    r = &log_ring[h & DEBUG_LOG_MASK];
+    r->tick = scheduler_now();
+    r->counts = hal_tick_timer_count();
+    r->arg[0] = a0;
+    r->arg[1] = a1;
+    r->arg[2] = a2;
+    r->arg[3] = a3;
+    __sync_synchronize();
+    r->fmt = fmt;
+}
+
+void debug_log_drain(void){
+    /* Format the oldest record into the debug print buffer. Called from the
+     * main loop in dead time, one record per call, and only when the buffer
+     * has room for a whole line so nothing is cut short. A record that is
+     * reserved but not yet written holds up the ones behind it. */
+    volatile log_record * r;
+    const char * fmt;
+    uint32_t dropped;
+#ifdef DEBUG_LOG_STAMP
+    char line[DEBUG_LOG_LINE_MAX + 1], * p;
+#endif
+    if (debug_print_free() < DEBUG_LOG_LINE_MAX){
+        return;
+    }
+    dropped = log_dropped;
+    if (dropped != log_reported){
+        xprintf("\r\n!log %u dropped\r\n", dropped - log_reported);
+        log_reported = dropped;
+        return;
+    }
+    if (log_tail == log_head){
+        return;
+    }
+    r = &log_ring[log_tail & DEBUG_LOG_MASK];
+    fmt = r->fmt;
+    if (fmt == 0){
+        return;
+    }
+#ifdef DEBUG_LOG_STAMP
+    /* The stamp and the line in one message, so nothing else printed gets
+     * between them. xsprintf() has already put the \r before each \n. */
+    p = line;
+    xsprintf(p, "[%u+%u] ", r->tick, r->counts);
+    while (*p){
+        p++;
+    }
+    xsprintf(p, fmt, r->arg[0], r->arg[1], r->arg[2], r->arg[3]);
+    while (*p){
+        p++;
+    }
+    debug_buf_write((const uint8_t *)line, p - line);
+#else
+    xprintf(fmt, r->arg[0], r->arg[1], r->arg[2], r->arg[3]);
+#endif
+    r->fmt = 0;
+    __sync_synchronize();
+    log_tail++;
+}
+
+uint32_t debug_log_pending(void){
+    return (log_tail != log_head) || (log_dropped != log_reported);
+}
+
+uint32_t debug_log_dropped(void){
+    return log_dropped;
+}
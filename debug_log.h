@@ -0,0 +1,47 @@
+/*
+ * File:   debug_log.h
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#ifndef _DEBUG_LOG_H
+#define _DEBUG_LOG_H
+
+#include "hal.h"
+
+/* Deferred debug print. debug_log() only stores the format pointer, a
+ * timestamp and up to DEBUG_LOG_ARGS raw 32 bit arguments in a ring of
+ * records - a few dozen cycles, with no parsing or number conversion. The
+ * records are run through xprintf() into the debug print buffer later, in
+ * scheduler dead time (debug_log_drain()).
+ * Because formatting happens later:
+ *  - the format string must be a literal (or otherwise never change)
+ *  - arguments are integers or chars (%d %u %x %c), not %s
+ * Safe from tasks and ISR's of any level. When the ring is full a record is
+ * dropped and counted, and the drain reports how many. */
+
+// #define to prefix each line with "[tick+counts] " (Timer 1 counts into the tick)
+//#define DEBUG_LOG_STAMP
+
+// records in the ring, must be 2^n
+#define DEBUG_LOG_SIZE 32
+#define DEBUG_LOG_ARGS 4
+
+// worst case chars one record prints, stamp included. The drain waits for
+// this much room, and with DEBUG_LOG_STAMP builds the line in this much stack
+#define DEBUG_LOG_LINE_MAX 80
+
+void init_debug_log(void);
+void debug_log_put(const char * fmt, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+void debug_log_drain(void);
+uint32_t debug_log_pending(void);
+uint32_t debug_log_dropped(void);
+
+// debug_log(fmt, ...) with 0 to DEBUG_LOG_ARGS arguments
+#define DEBUG_LOG_(fmt, a0, a1, a2, a3, ...) \
+    debug_log_put((fmt), (uint32_t)(a0), (uint32_t)(a1), (uint32_t)(a2), (uint32_t)(a3))
+#define debug_log(...) DEBUG_LOG_(__VA_ARGS__, 0, 0, 0, 0, 0)
+
+#endif // _DEBUG_LOG_H
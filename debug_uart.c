@@ -9,8 +9,8 @@
 #define CRITICAL_SECTION_SYNC
 
 #include "debug_uart.h"
+#include "trace.h"
 #include "xprintf.h"
-#include <sys/attribs.h>
 
 void debug_buf_put(uint8_t c);
 void usb_putc(uint8_t c);
@@ -21,65 +21,221 @@ void usb_putc(uint8_t c);
 
 typedef struct {
     uint8_t buffer[DEBUG_PRINT_BUF_SIZE];
+    uint8_t span[DEBUG_PRINT_BUF_SIZE]; // at the first char of a message, its length once committed
     uint32_t head;
     uint32_t tail;
+    uint32_t dropped;       // messages lost, buffer full
+    uint32_t overflow;      // chars in them
 } debug_print_buffer;
 
 volatile debug_print_buffer debug_buf;
 
+// committed chars from tail on, found by the drain and not yet sent
+static uint32_t ready = 0;
+
+#ifdef DEBUG_UART_DMA
+// bytes in the DMA transfer in flight (from tail), 0 when the DMA is idle
+static volatile uint32_t dma_len = 0;
+#endif
+
 void init_debug_uart(void){
     /* The debug print buffer. 
-     * Empty when head == tail, full when tail + 1 == head
-     * NOTE that head is an int that can be LARGER than the buffer size. 
-     * It must ALWAYS be and'd with DEBUG_PRINT_BUFFER_MASK !
-     * (This makes it possible to use __sync_fetch_and_add() to implement
-     *  critical section.)
+     * Empty when head == tail, full when head - tail == DEBUG_PRINT_BUF_SIZE
+     * NOTE that head and tail are ints that can be LARGER than the buffer
+     * size. They must ALWAYS be and'd with DEBUG_PRINT_BUFFER_MASK !
+     * (This makes it possible to use __sync_bool_compare_and_swap() to
+     *  implement critical section.)
      */
+    uint32_t i;
+    for (i = 0; i < DEBUG_PRINT_BUF_SIZE; i++){
+        debug_buf.span[i] = 0;
+    }
     debug_buf.head = 0; 
     debug_buf.tail = 0;
+    debug_buf.dropped = 0;
+    debug_buf.overflow = 0;
+    ready = 0;
     xdev_out(debug_buf_put);
+    xdev_out_block(debug_buf_write);
 }
 
-void debug_buf_put(uint8_t c){
-    if ( ((debug_buf.head + 1) & DEBUG_PRINT_BUFFER_MASK) == debug_buf.tail){
-        return; // buffer is full
-    } else {
-        // critical section
+uint32_t debug_buf_try_write(const uint8_t * s, uint32_t n){
+    /* Put a whole message in the buffer, or return 0 if there is not room.
+     * 1. reserve n chars by moving head on, in one step, so a higher
+     *    level ISR printing in the middle of this gets the space after it
+     * 2. copy the message in
+     * 3. commit it by writing its length in span[], last. The drain only
+     *    ever sends committed messages, so it never sends half of one. */
+    uint32_t h, i;
+    if (n == 0 || n >= DEBUG_PRINT_BUF_SIZE){
+        return 0; // span[] holds up to 255
+    }
 #ifdef CRITICAL_SECTION_SYNC
-        /* Critical section using LL/SC pair. This is the optimal setting. */
-        volatile uint32_t * p = &debug_buf.head;
-        uint32_t h = __sync_fetch_and_add(p, 1);
-        debug_buf.buffer[h & DEBUG_PRINT_BUFFER_MASK] = c;
+    /* Critical section using LL/SC pair. This is the optimal setting. */
+    do {
+        h = debug_buf.head;
+        if (h - debug_buf.tail + n > DEBUG_PRINT_BUF_SIZE){
+            return 0; // buffer is full
+        }
+    } while (!__sync_bool_compare_and_swap(&debug_buf.head, h, h + n));
 #else 
-        /* no critical section for test purposes - or you can uncomment the 
-         enable/disable ints for critical section at timing */
-        //__builtin_disable_interrupts();
-        debug_buf.buffer[(debug_buf.head & DEBUG_PRINT_BUFFER_MASK)] = c;
-        debug_buf.head++;
-        //__builtin_enable_interrupts();
+    /* no critical section for test purposes - or you can uncomment the 
+     enable/disable ints for critical section at timing */
+    //__builtin_disable_interrupts();
+    h = debug_buf.head;
+    if (h - debug_buf.tail + n > DEBUG_PRINT_BUF_SIZE){
+        return 0; // buffer is full
+    }
+    debug_buf.head = h + n;
+    //__builtin_enable_interrupts();
+#endif
+    for (i = 0; i < n; i++){
+        debug_buf.buffer[(h + i) & DEBUG_PRINT_BUFFER_MASK] = s[i];
+    }
+    __sync_synchronize();
+    debug_buf.span[h & DEBUG_PRINT_BUFFER_MASK] = (uint8_t)n;
+
+#ifdef DEBUG_UART_DMA
+    if (dma_len == 0){
+        hal_uart_dma_kick(); // DMA ISR starts the transfer
+    }
 #endif
-        
+    return 1;
+}
+
+void debug_buf_write(const uint8_t * s, uint32_t n){
+    /* Put a whole message in the buffer, or drop it and count it. One too
+     * long for the buffer is dropped and counted the same. */
+    if (n == 0){
+        return;
+    }
+    if (!debug_buf_try_write(s, n)){
+        __sync_fetch_and_add(&debug_buf.dropped, 1);
+        __sync_fetch_and_add(&debug_buf.overflow, n);
+        trace_event(TRACE_PRINT_DROP, 0, n);
     }
 }
 
+void debug_buf_put(uint8_t c){
+    /* One char is a message on its own (xputc/xputs) */
+    debug_buf_write(&c, 1);
+}
+
+static uint32_t debug_buf_ready(void){
+    /* Chars from tail that are committed. Runs on in whole messages until
+     * one that is reserved but not yet committed, or head. Only the drain
+     * calls this, so it owns ready and clears span[] as it goes. */
+    uint32_t p = debug_buf.tail + ready;
+    uint32_t n;
+    while (p != debug_buf.head){
+        n = debug_buf.span[p & DEBUG_PRINT_BUFFER_MASK];
+        if (n == 0){
+            break; // being written
+        }
+        debug_buf.span[p & DEBUG_PRINT_BUFFER_MASK] = 0;
+        ready += n;
+        p += n;
+    }
+    return ready;
+}
+
+#ifdef DEBUG_UART_DMA
+
+static void dma_service(void){
+    /* Retire a finished transfer and start the next one. The DMA reads
+     * straight out of the ring, so a run that wraps goes as two transfers:
+     * up to the end of the buffer, then from the start. tail only moves on
+     * once the bytes are gone, so producers cannot overwrite them. The
+     * interrupt flag is cleared before block complete is read, and only a
+     * block complete that was seen is cleared: one that lands in between
+     * then runs this again, rather than being lost with the drain stuck. */
+    uint32_t tail, n;
+    hal_uart_dma_ack();
+    if (hal_uart_dma_done()){
+        hal_uart_dma_done_ack();
+        debug_buf.tail += dma_len;
+        ready -= dma_len;
+        dma_len = 0;
+    }
+    if (dma_len){
+        return; // just a kick, the transfer in flight will pick it up
+    }
+    n = debug_buf_ready();
+    if (n){
+        tail = debug_buf.tail & DEBUG_PRINT_BUFFER_MASK;
+        if (n > DEBUG_PRINT_BUF_SIZE - tail){
+            n = DEBUG_PRINT_BUF_SIZE - tail;
+        }
+        dma_len = n;
+        hal_uart_dma_start((const uint8_t *)&debug_buf.buffer[tail], dma_len);
+    }
+}
+
+void __ISR(_DMA_0_VECTOR, IPL1AUTO) DebugUartDma(void){
+    /* Block complete, or a kick from debug_buf_write() */
+    dma_service();
+}
+
+void debug_print_char(void){
+    /* Nothing to do, the DMA ISR feeds the UART */
+}
+
+void debug_print_poll(void){
+    /* For use with interrupts off (fatal_error): run the DMA ISR by hand */
+    if (hal_uart_dma_irq_pending()){
+        dma_service();
+    }
+}
+
+uint32_t debug_print_pending(void){
+    /* Never anything for the main loop to feed */
+    return 0;
+}
+
+#else
+
 void debug_print_char(void){
     /* Print a character from the buffer, if the UART tx is free, and there is
      * one to print. Because this is only called at low priority, in the "dead" 
      * time of the main scheduler, there is no need to protect it with a 
      * critical section.
      */
-    if (U1STAbits.UTXBF == 0){
-        // UART is free, is there something in the buffer?
-        if ( (debug_buf.head & DEBUG_PRINT_BUFFER_MASK) != debug_buf.tail){
-            U1TXREG = debug_buf.buffer[debug_buf.tail];
+    if (hal_uart_tx_ready()){
+        // UART is free, is there a committed char in the buffer?
+        if (ready || debug_buf_ready()){
+            hal_uart_tx(debug_buf.buffer[debug_buf.tail & DEBUG_PRINT_BUFFER_MASK]);
+            ready--;
             debug_buf.tail++;
-            debug_buf.tail &= DEBUG_PRINT_BUFFER_MASK;
         }
     }
 }
 
+void debug_print_poll(void){
+    debug_print_char();
+}
+
+uint32_t debug_print_pending(void){
+    /* True while there is something in the buffer for the main loop to send */
+    return debug_buf.head != debug_buf.tail;
+}
+
+#endif // DEBUG_UART_DMA
+
+uint32_t debug_print_free(void){
+    /* Room left in the buffer, in chars */
+    return DEBUG_PRINT_BUF_SIZE - (debug_buf.head - debug_buf.tail);
+}
+
+uint32_t debug_print_dropped(void){
+    return debug_buf.dropped;
+}
+
+uint32_t debug_print_overflow(void){
+    return debug_buf.overflow;
+}
+
 void usb_putc(uint8_t c){
-    while(U1STAbits.UTXBF);
-    U1TXREG = c;
+    while(!hal_uart_tx_ready());
+    hal_uart_tx(c);
 }
 
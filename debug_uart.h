@@ -9,9 +9,28 @@
 #ifndef _DEBUG_UART_H    
 #define _DEBUG_UART_H
 
-#include <xc.h>
+#include "hal.h"
+
+// Feed UART 1 straight from the print buffer with DMA channel 0, instead of
+// one char per debug_print_char() call in scheduler dead time. The drain then
+// keeps going however busy the scheduler is.
+//#define DEBUG_UART_DMA
 
 void init_debug_uart(void);
 void debug_print_char(void);
+void debug_print_poll(void);
+uint32_t debug_print_pending(void);
+uint32_t debug_print_free(void);
+
+// A whole message, of any bytes, into the buffer. debug_buf_try_write()
+// returns 0 and leaves it if there is no room, debug_buf_write() drops it
+// and counts it.
+uint32_t debug_buf_try_write(const uint8_t * s, uint32_t n);
+void debug_buf_write(const uint8_t * s, uint32_t n);
+
+// Each xprintf() goes into the buffer whole, or not at all if there is no
+// room. Messages lost that way, and the chars in them:
+uint32_t debug_print_dropped(void);
+uint32_t debug_print_overflow(void);
 
-#endif // _DEBUG_UART_H 
+#endif // _DEBUG_UART_H
@@ -0,0 +1,153 @@
+/*
+ * File:   fast_tier.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#include "fast_tier.h"
+#include "initialise.h"
+#include "scheduler.h"
+#include "trace.h"
+#include "timestamp.h"
+
+// running[] holds no task at the bottom
+#define FAST_IDLE FAST_MAX_TASKS
+
+typedef struct {
+    uint32_t period;            // in fast ticks
+    int32_t  elapsed;           // fast ticks since the last release
+    void (*TickFct)(void);
+    uint32_t active;
+    uint32_t running;           // released and not finished (maybe preempted)
+    uint32_t misses;
+#ifdef PROFILE_TASKS
+    profile_stats stats;        // core timer cycles, including any preemption
+#endif
+} fast_task;
+
+static fast_task fast_tasks[FAST_MAX_TASKS];
+static uint8_t running[FAST_MAX_TASKS + 1];     // stack of running tasks
+static uint32_t depth = 0;                      // top of running[]
+static volatile uint32_t fast_ticks = 0;
+static volatile uint32_t overruns = 0;
+static uint32_t num_active = 0;
+
+void init_fast_tier(void){
+    uint32_t t;
+    for (t = 0; t < FAST_MAX_TASKS; t++){
+        fast_tasks[t].active = 0;
+        fast_tasks[t].running = 0;
+    }
+    running[0] = FAST_IDLE;
+    depth = 0;
+    num_active = 0;
+    hal_fast_timer_stop();
+}
+
+uint32_t fast_add_task(void (*fn)(void), uint32_t period, uint32_t offset){
+    /* The entry is filled in with interrupts off, so FastTick() never sees
+     * half a task. */
+    uint32_t t;
+    if (fn == 0 || period == 0){
+        fatal_error("Bad fast task.", period);
+    }
+    for (t = 0; t < FAST_MAX_TASKS; t++){
+        if (!fast_tasks[t].active){
+            hal_disable_interrupts();
+            fast_tasks[t].TickFct = fn;
+            fast_tasks[t].period = period;
+            fast_tasks[t].elapsed = -(int32_t)offset;
+            fast_tasks[t].running = 0;
+            fast_tasks[t].misses = 0;
+#ifdef PROFILE_TASKS
+            profile_reset(&fast_tasks[t].stats);
+#endif
+            fast_tasks[t].active = 1;
+            hal_enable_interrupts();
+            if (num_active++ == 0){
+                hal_fast_timer_start(FAST_TICK_TIMER);
+            }
+            return t;
+        }
+    }
+    fatal_error("Fast task table full.", FAST_MAX_TASKS);
+    return 0;
+}
+
+void fast_remove_task(uint32_t h){
+    if (h >= FAST_MAX_TASKS || !fast_tasks[h].active){
+        fatal_error("Bad fast task handle.", h);
+    }
+    fast_tasks[h].active = 0;
+    if (--num_active == 0){
+        hal_fast_timer_stop();
+    }
+}
+
+uint32_t fast_now(void){
+    return fast_ticks;
+}
+
+uint32_t fast_task_misses(uint32_t h){
+    return (h < FAST_MAX_TASKS) ? fast_tasks[h].misses : 0;
+}
+
+uint32_t fast_overruns(void){
+    return overruns;
+}
+
+#ifdef PROFILE_TASKS
+const profile_stats * fast_task_profile(uint32_t h){
+    if (h >= FAST_MAX_TASKS || !fast_tasks[h].active){
+        return 0;
+    }
+    return &fast_tasks[h].stats;
+}
+#endif
+
+void __ISR(_TIMER_3_VECTOR, IPL3AUTO) FastTick(void){
+    /* TIMER 3 generates the 1ms fast tier ticks. As RIOS: run each task that
+     * is due and has a higher priority (lower index) than the one this
+     * interrupt preempted, letting Timer 3 in again while it runs. Every
+     * FastTick() counts every task on by one tick, nested or not. */
+    uint32_t t;
+    trace_event(TRACE_ISR_ENTER, TRACE_ISR_TIMER3, 0);
+    hal_fast_timer_ack();
+    fast_ticks++;
+    for (t = 0; t < FAST_MAX_TASKS; t++){
+        fast_task * f = &fast_tasks[t];
+        if (!f->active){
+            continue;
+        }
+        if (f->elapsed >= (int32_t)f->period){
+            if (f->running){
+                if (f->elapsed == (int32_t)f->period){ // once per release
+                    if (scheduler_overrun_policy() == OVERRUN_FATAL){
+                        fatal_error("Fast Tier Overrun Error.", t);
+                    }
+                    f->misses++;
+                    overruns++;
+                }
+            } else if (running[depth] > t){
+                uint32_t s, start = timestamp_now32();
+                f->elapsed = 0;
+                f->running = 1;
+                running[++depth] = t;
+                trace_event(TRACE_FAST_START, t, fast_ticks);
+                s = hal_fast_nest_begin();
+                f->TickFct(); // Go
+                hal_fast_nest_end(s);
+                trace_event(TRACE_FAST_END, t, 0);
+#ifdef PROFILE_TASKS
+                profile_record(&f->stats, start, timestamp_now32());
+#endif
+                depth--;
+                f->running = 0;
+            }
+        }
+        f->elapsed++;
+    }
+    trace_event(TRACE_ISR_EXIT, TRACE_ISR_TIMER3, 0);
+}
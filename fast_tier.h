@@ -0,0 +1,46 @@
+/*
+ * File:   fast_tier.h
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#ifndef _FAST_TIER_H
+#define _FAST_TIER_H
+
+#include "hal.h"
+#include "profile.h"
+
+/* Preemptive fast tier, RIOS preemptive style. Timer 3 ticks every 1ms at
+ * IPL3, above the 5ms scheduler tick and the other ISR's, and FastTick()
+ * runs the fast tasks that are due straight from the interrupt. A fast task
+ * is preempted by any higher priority fast task that comes due while it
+ * runs (but never by itself). Priority is table order: the first task added
+ * is the highest. So a fast loop gets bounded latency whatever the 5ms tier
+ * is doing.
+ * Keep fast tasks short: their time comes off every tier below them.
+ * Timer 3 only runs while there is at least one fast task. */
+
+// size of the fast task table
+#define FAST_MAX_TASKS 8
+
+void init_fast_tier(void);
+
+// add/remove from main or a task (not from ISR's). The task is first
+// released offset + period fast ticks from now, then every period.
+uint32_t fast_add_task(void (*fn)(void), uint32_t period, uint32_t offset);
+void fast_remove_task(uint32_t h);
+
+uint32_t fast_now(void);
+// releases that came while the task was still running from the last one.
+// They are overruns, handled by the scheduler's overrun policy (fatal, or
+// counted and the release runs late).
+uint32_t fast_task_misses(uint32_t h);
+uint32_t fast_overruns(void);
+#ifdef PROFILE_TASKS
+// in core timer cycles, as the 5ms tier's, with any time preempted
+const profile_stats * fast_task_profile(uint32_t h);
+#endif
+
+#endif // _FAST_TIER_H
@@ -0,0 +1,117 @@
+/*
+ * File:   hal.h
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#ifndef _HAL_H
+#define _HAL_H
+
+/*
+ * Thin hardware layer under the scheduler and debug print. On the MAX32
+ * these are just the register accesses, so there is no extra cost. Define
+ * HOST_SIM (the sim/ Makefile does) to build against the Linux simulation
+ * backend instead, which gives a virtual Timer1, UART and pins.
+ */
+
+#ifdef HOST_SIM
+
+#include "hal_sim.h"
+
+#else
+
+#include <xc.h>
+#include <sys/attribs.h>
+
+// outputs
+// the on board green LED
+#define RUN_LED LATAbits.LATA3
+// pin 22 on the MAX32 - just for verifying timing with scope.
+// You can remove it if you want.
+#define DEBUG_PIN LATCbits.LATC2
+
+// Timer 1 (Task Scheduler Ticks)
+#define hal_tick_timer_count()      (TMR1)
+#define hal_tick_timer_period()     (PR1)
+#define hal_tick_timer_ack()        (IFS0bits.T1IF = 0)
+#define hal_tick_timer_pending()    (IFS0bits.T1IF)
+#define hal_tick_timer_set_period(pr) (PR1 = (pr))
+
+// Timer 2 (one shot, the software timer service in swtimer.c)
+#define hal_timer2_start(pr)        do { T2CONbits.ON = 0; TMR2 = 0; \
+                                         PR2 = (pr); T2CONbits.ON = 1; } while (0)
+#define hal_timer2_stop()           (T2CONbits.ON = 0)
+#define hal_timer2_ack()            (IFS0bits.T2IF = 0)
+
+// Timer 3 (fast tier ticks, IPL3)
+#define hal_fast_timer_start(pr)    do { T3CONbits.ON = 0; TMR3 = 0; \
+                                         PR3 = (pr); T3CONbits.ON = 1; } while (0)
+#define hal_fast_timer_stop()       (T3CONbits.ON = 0)
+#define hal_fast_timer_count()      (TMR3)
+#define hal_fast_timer_period()     (PR3)
+#define hal_fast_timer_ack()        (IFS0bits.T3IF = 0)
+// In the fast tier ISR: let another Timer 3 interrupt in by dropping the CPU
+// priority below IPL3, and put it back. Lower levels stay masked.
+#define hal_fast_nest_begin()       hal_cpu_set_ipl(2)
+#define hal_fast_nest_end(s)        _CP0_SET_STATUS(s)
+#define hal_cpu_set_ipl(ipl)        ({ uint32_t _s = _CP0_GET_STATUS(); \
+                                       _CP0_SET_STATUS((_s & ~_CP0_STATUS_IPL_MASK) | \
+                                           ((ipl) << _CP0_STATUS_IPL_POSITION)); _s; })
+
+// UART 1 (debug print)
+#define hal_uart_tx_ready()         (U1STAbits.UTXBF == 0)
+#define hal_uart_tx(c)              (U1TXREG = (c))
+// and its receive side (the command console, console.c). An overrun stops
+// the receiver until OERR is cleared, which empties the FIFO.
+#define hal_uart_rx_ready()         (U1STAbits.URXDA)
+#define hal_uart_rx()               ((uint8_t)U1RXREG)
+#define hal_uart_rx_overrun()       (U1STAbits.OERR ? (U1STACLR = _U1STA_OERR_MASK, 1) : 0)
+#define hal_uart_rx_ack()           (IFS0CLR = _IFS0_U1RXIF_MASK)
+
+// DMA channel 0 -> UART 1 TX, one byte per U1TX event (DEBUG_UART_DMA)
+#define hal_uart_dma_start(src, len) do { DCH0SSA = KVA_TO_PA(src); \
+                                         DCH0SSIZ = (len); DCH0CONbits.CHEN = 1; \
+                                         DCH0ECONbits.CFORCE = 1; } while (0)
+// block complete, and clearing it once seen; ack only clears DMA0IF, so a
+// block that completes after it sets it again
+#define hal_uart_dma_done()         (DCH0INTbits.CHBCIF)
+#define hal_uart_dma_done_ack()     (DCH0INTCLR = _DCH0INT_CHBCIF_MASK)
+#define hal_uart_dma_ack()          (IFS1CLR = _IFS1_DMA0IF_MASK)
+#define hal_uart_dma_kick()         (IFS1SET = _IFS1_DMA0IF_MASK)
+#define hal_uart_dma_irq_pending()  (IFS1bits.DMA0IF)
+
+// CP0 Count, the core timer (SYSCLK / 2)
+#define hal_core_timer()            _CP0_GET_COUNT()
+
+// The stack, from the XC32 linker script: it grows down from _stack, through
+// the free RAM, to _splim at the end of the heap (stack.c)
+extern uint32_t _stack[], _splim[];
+#define hal_stack_top()             (_stack)
+#define hal_stack_limit()           (_splim)
+// data RAM: the size of it (BMXDRMSZ), and what the link put below the
+// stack, as RAM starts at physical 0
+#define hal_ram_size()              (BMXDRMSZ)
+#define hal_ram_static()            (KVA_TO_PA(_splim))
+// program flash, through KSEG0 so reads are cached, and the size of it
+#define hal_flash_base()            ((const uint8_t *)0x9D000000)
+#define hal_flash_size()            (BMXPFMSZ)
+
+// interrupts
+#define hal_disable_interrupts()    __builtin_disable_interrupts()
+#define hal_enable_interrupts()     __builtin_enable_interrupts()
+// a critical section that can nest, in an ISR too: restore puts back the
+// interrupt enable as it was, rather than turning it on
+#define hal_irq_save()              __builtin_disable_interrupts()
+#define hal_irq_restore(s)          do { if ((s) & _CP0_STATUS_IE_MASK) \
+                                         __builtin_enable_interrupts(); } while (0)
+
+// Idle the CPU until any interrupt. OSCCON.SLPEN is 0 from reset, so WAIT
+// is Idle mode and the timers and UART keep running. With interrupts
+// disabled the core still wakes, and carries on after the WAIT.
+#define hal_cpu_idle()              _wait()
+
+#endif // HOST_SIM
+
+#endif // _HAL_H
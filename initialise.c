@@ -7,10 +7,21 @@
  */
 
 #include "initialise.h"
+#include "console.h"
 #include "debug_uart.h"
+#include "debug_log.h"
+#include "trace.h"
+#include "timestamp.h"
+#include "stack.h"
 
 void initialise(void){
     
+    // before the stack has been used much, so all of the rest is painted
+    stack_paint();
+
+    // program flash wait states for SYSCLK (7 from reset)
+    CHECONbits.PFMWS = FLASH_WAIT_STATES;
+
     // clock out
     OSCCONbits.COSC = 0b011; // pri osc with PLL
     
@@ -42,35 +53,63 @@ void initialise(void){
     // Timer 1 (Task Scheduler Ticks)
     T1CONbits.ON = 0;           // timer off
     T1CONbits.TCS = 0;          // use internal clock
-    T1CONbits.TCKPS1 = 1;       // prescale by 64
-    T1CONbits.TCKPS0 = 0;       //    => 1.3us @ 48MHz
-    PR1 = SYSTEM_TICK_TIMER;    // System Timer tick is 5ms 
+    T1CONbits.TCKPS = TICK_T1_TCKPS;    // prescale by TICK_PRESCALE
+    PR1 = SYSTEM_TICK_TIMER;    // System Timer tick is TICK_US
     T1CONbits.TGATE = 0;        // no gating
     TMR1 = 0; 
     T1CONbits.ON = 1;           // timer on
     
-    // Timer 2 ( for demonstrating debug prints from an ISR)
-    // only used for test/demo tasks.
+    // Timer 2 (software timers, see swtimer.c)
+    // started for the next deadline
     T2CONbits.ON = 0;           // timer off
     T2CONbits.TCS = 0;          // use internal clock
-    T2CONbits.TCKPS2 = 1;       // prescale by 64
-    T2CONbits.TCKPS1 = 1;       
-    T2CONbits.TCKPS0 = 0;       //    => 1.3us @ 48MHz
+    T2CONbits.TCKPS = SWTIMER_T2_TCKPS; // prescale by SWTIMER_PRESCALE
     T2CONbits.T32 = 0;          // 16 bit mode
     PR2 = 0;                   // set in task in fact
     T2CONbits.TGATE = 0;        // no gating
     TMR2 = 0; 
     
+    // Timer 3 (fast tier ticks, see fast_tier.c)
+    // started when the first fast task is added
+    T3CONbits.ON = 0;           // timer off
+    T3CONbits.TCS = 0;          // use internal clock
+    T3CONbits.TCKPS = TICK_T23_TCKPS;   // as Timer 1
+    PR3 = FAST_TICK_TIMER;      // FAST_TICK_US
+    T3CONbits.TGATE = 0;        // no gating
+    TMR3 = 0; 
+    
     // U1 is for debug over USB serial for MAX32 board
     U1MODEbits.BRGH = 1;
-    U1BRG = 12;              // 921.6kb
+    U1BRG = DEBUG_UART_BRG;     // DEBUG_BAUD
     U1MODEbits.STSEL = 0;   // 1 stop bit
     U1MODEbits.PDSEL0 = 0;  // 8 bits, no parity
     U1MODEbits.PDSEL1 = 0;
     U1STAbits.UTXEN = 1;
+#ifdef DEBUG_CONSOLE
+    U1STAbits.URXEN = 1;
+    U1STAbits.URXISEL = 0;      // interrupt on each char received
+#else
     U1STAbits.URXEN = 0;
+#endif
     U1MODEbits.ON = 1;
     
+#ifdef DEBUG_UART_DMA
+    // DMA channel 0 moves the debug print buffer into U1TXREG, one byte
+    // each time the TX FIFO has room. Source and size are set per transfer.
+    U1STAbits.UTXISEL = 0;      // U1TX event while the FIFO has space
+    DMACONbits.ON = 1;
+    DCH0CON = 0;
+    DCH0CONbits.CHPRI = 3;
+    DCH0ECON = 0;
+    DCH0ECONbits.CHSIRQ = _UART1_TX_IRQ;
+    DCH0ECONbits.SIRQEN = 1;    // start a cell on that event
+    DCH0DSA = KVA_TO_PA(&U1TXREG);
+    DCH0DSIZ = 1;
+    DCH0CSIZ = 1;               // one byte per event
+    DCH0INTCLR = 0xFF;
+    DCH0INTbits.CHBCIE = 1;     // interrupt at block complete
+#endif
+    
     // --- Initialise INTERRUPTS ---
     INTCONbits.MVEC = 1; // multi vector
     INTCONbits.TPC = 0; // no proximity timer
@@ -80,12 +119,34 @@ void initialise(void){
     IPC1bits.T1IS = 0; // doesn't matter, no groups
     IFS0bits.T1IF = 0; // reset the flag
     IEC0bits.T1IE = 1; // enable ints for T1
-    // T2 interrupt - priority 2 (for test code)
+    // T2 interrupt - priority 2 (software timers)
     IPC2bits.T2IP = 2; // T1 - priority 2
     IPC2bits.T2IS = 0; // doesn't matter, no groups
     IFS0bits.T2IF = 0; // reset the flag
     IEC0bits.T2IE = 1; // enable ints for T2
+    // T3 interrupt - priority 3 (fast tier, preempts everything above)
+    IPC3bits.T3IP = 3;
+    IPC3bits.T3IS = 0;
+    IFS0bits.T3IF = 0;
+    IEC0bits.T3IE = 1;
+#ifdef DEBUG_CONSOLE
+    // U1 RX interrupt - priority 1 (command console)
+    IPC6bits.U1IP = 1;
+    IPC6bits.U1IS = 0;
+    IFS0bits.U1RXIF = 0;
+    IEC0bits.U1RXIE = 1;
+#endif
+#ifdef DEBUG_UART_DMA
+    // DMA0 interrupt - priority 1 (debug print drain)
+    IPC9bits.DMA0IP = 1;
+    IPC9bits.DMA0IS = 0;
+    IFS1bits.DMA0IF = 0;
+    IEC1bits.DMA0IE = 1;
+#endif
     
+    init_timestamp();
     init_debug_uart();
+    init_debug_log();
+    init_trace();
 }
 
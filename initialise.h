@@ -9,18 +9,13 @@
 #ifndef INITIALISE_H
 #define	INITIALISE_H
 
-#include <xc.h>
-#include <sys/attribs.h>
+#include "hal.h"
+#include "clock_config.h"
 
-// outputs
-// the on board green LED
-#define RUN_LED LATAbits.LATA3
-// pin 22 on the MAX32 - just for verifying timing with scope.
-// You can remove it if you want.
-#define DEBUG_PIN LATCbits.LATC2
+// outputs RUN_LED and DEBUG_PIN are defined in hal.h
 
-// value of PR1, system tick timer = 5ms @ 48MHz Timer 1 prescaler = 64
-#define SYSTEM_TICK_TIMER 3750
+// SYSTEM_TICK_TIMER (PR1), FAST_TICK_TIMER (PR3), the ticks per second,
+// TICK_TIMER_HZ and CORE_TIMER_HZ come from the clocks in clock_config.h
 
 void initialise(void);
 
@@ -10,9 +10,15 @@
 #include <stdlib.h>
 #include "initialise.h"
 #include "scheduler.h"
+#include "debug_uart.h"
+#include "debug_log.h"
+#include "trace.h"
+#include "background.h"
+#include "console.h"
+#include "stack.h"
 #include "xprintf.h"
-#include <xc.h>
 
+#ifndef HOST_SIM
 // DEVCFG3
 #pragma config FVBUSONIO = OFF          // USB VBUS ON Selection (Controlled by Port Function)
 
@@ -20,12 +26,20 @@
 // we have an 8MHz XTAL on the MAX32. This is how the clocking is worked out:
 //  - the PLL input has to be from 4 to5MHz, so we divide by 2 to get 4MHz
 //  - to get our Tri Sensor baud rate of 921.6 kbaud it turns out that PBclk = 48MHz is best (<1% err)
-//  - CPU clock is maximum of 80MHz, so we use 48MHz for that too.
+//  - CPU clock is maximum of 80MHz; 80MHz still gives 921.6k within 1.4%
+// SYSCLK_HZ and PBCLK_HZ are set in clock_config.h
 #pragma config FPLLIDIV = DIV_2         // PLL Input Divider (2x Divider)
-#pragma config FPLLMUL = MUL_24         // PLL Multiplier (20x Multiplier)
+#if SYSCLK_HZ == 48000000UL
+#pragma config FPLLMUL = MUL_24         // PLL Multiplier (24x Multiplier)
+#pragma config FPLLODIV = DIV_2         // System PLL Output Clock Divider (PLL Divide by 2)
+#elif SYSCLK_HZ == 80000000UL
+#pragma config FPLLMUL = MUL_20         // PLL Multiplier (20x Multiplier)
+#pragma config FPLLODIV = DIV_1         // System PLL Output Clock Divider (PLL Divide by 1)
+#else
+#error "no PLL setting for SYSCLK_HZ, add one here"
+#endif
 #pragma config UPLLIDIV = DIV_12        // USB PLL Input Divider 
 #pragma config UPLLEN = OFF             // USB PLL Enable (Disabled and Bypassed)
-#pragma config FPLLODIV = DIV_2         // System PLL Output Clock Divider (PLL Divide by 1)
 
 // DEVCFG1
 #pragma config FNOSC = PRIPLL           // Oscillator Selection Bits (Primary Osc w/PLL (XT+,HS+,EC+PLL))
@@ -33,7 +47,15 @@
 #pragma config IESO = ON                // Internal/External Switch Over (Enabled)
 #pragma config POSCMOD = XT             // Primary Oscillator Configuration (XT osc mode)
 #pragma config OSCIOFNC = OFF           // CLKO Output Signal Active on the OSCO Pin (Disabled)
+#if PBCLK_HZ == SYSCLK_HZ
 #pragma config FPBDIV = DIV_1           // Peripheral Clock Divisor (Pb_Clk is Sys_Clk/1)
+#elif PBCLK_HZ * 2 == SYSCLK_HZ
+#pragma config FPBDIV = DIV_2           // Peripheral Clock Divisor (Pb_Clk is Sys_Clk/2)
+#elif PBCLK_HZ * 4 == SYSCLK_HZ
+#pragma config FPBDIV = DIV_4           // Peripheral Clock Divisor (Pb_Clk is Sys_Clk/4)
+#else
+#pragma config FPBDIV = DIV_8           // Peripheral Clock Divisor (Pb_Clk is Sys_Clk/8)
+#endif
 #pragma config FCKSM = CSDCMD           // Clock Switching and Monitor Selection (Clock Switch Disable, FSCM Disabled)
 #pragma config WDTPS = PS1048576        // Watchdog Timer Postscaler (1:1048576)
 #pragma config FWDTEN = OFF             // Watchdog Timer Enable (WDT Disabled (SWDTEN Bit Controls))
@@ -44,21 +66,29 @@
 #pragma config PWP = OFF                // Program Flash Write Protect (Disable)
 #pragma config BWP = OFF                // Boot Flash Write Protect bit (Protection Disabled)
 #pragma config CP = OFF                 // Code Protect (Protection Disabled)
+#endif // HOST_SIM
 
 // --- EXECUTION ---
 int32_t main(int32_t argc, char** argv) {
     
-    __builtin_disable_interrupts();
+    hal_disable_interrupts();
     initialise();
     init_scheduler();
+    init_console();
     xprintf("\r\nMAX32 RT Scheduler V1.0\r\n");
     xprintf("=======================\r\n");
-    __builtin_enable_interrupts();
+    hal_enable_interrupts();
 
     while(1){
       run_scheduler();
       while (!timer_tick()) {
+          scheduler_run_events();
+          debug_log_drain();
+          trace_drain();
           debug_print_char();
+          background_run();
+          stack_scan();
+          scheduler_idle();
       }
     }
 }
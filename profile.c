@@ -0,0 +1,84 @@
+/*
+ * File:   profile.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#include "profile.h"
+#include "xprintf.h"
+
+void profile_reset(profile_stats * s){
+    uint32_t i;
+    s->count = 0;
+    s->min = 0xFFFFFFFF;
+    s->max = 0;
+    s->total = 0;
+    for (i = 0; i < PROFILE_HIST_BINS; i++){
+        s->hist[i] = 0;
+    }
+}
+
+void profile_record(profile_stats * s, uint32_t start, uint32_t end){
+    /* start and end are timestamp_now32() values, so the difference is
+     * right even if Count wrapped in between. */
+    profile_add(s, end - start);
+}
+
+void profile_add(profile_stats * s, uint32_t t){
+    /* One run of t core timer cycles */
+    uint32_t bin;
+    s->count++;
+    s->total += t;
+    if (t < s->min){
+        s->min = t;
+    }
+    if (t > s->max){
+        s->max = t;
+    }
+    // log2 bin, CLZ is a single instruction on the M4K
+    bin = t ? 32 - __builtin_clz(t) : 0;
+    if (bin >= PROFILE_HIST_BINS){
+        bin = PROFILE_HIST_BINS - 1;
+    }
+    if (s->hist[bin] != 0xFFFF){
+        s->hist[bin]++;
+    }
+}
+
+uint32_t profile_mean(const profile_stats * s){
+    if (s->count == 0){
+        return 0;
+    }
+    return (uint32_t)(s->total / s->count);
+}
+
+// the longest line, every field at its widest, less the line end
+#define PROFILE_LINE_MAX (11 + 12 + 33 + 2 + 6 * PROFILE_HIST_BINS)
+
+void profile_print(uint32_t id, const profile_stats * s){
+    /* One compact line: P<id> n<calls> min/mean/max h <histogram bins>
+     * The histogram stops at the last non empty bin. The line is built in
+     * memory and sent as one message, so nothing printed at the same time
+     * (an ISR, the log drain) lands in the middle of it. */
+    char line[PROFILE_LINE_MAX + 1], * p = line;
+    uint32_t i, last = 0;
+    if (s->count == 0){
+        xprintf("P%u -\r\n", id);
+        return;
+    }
+    for (i = 0; i < PROFILE_HIST_BINS; i++){
+        if (s->hist[i]){
+            last = i;
+        }
+    }
+    xsprintf(p, "P%u n%u %u/%u/%u h", id, s->count, s->min, profile_mean(s), s->max);
+    for (i = 0; i <= last; i++){
+        while (*p){
+            p++;
+        }
+        xsprintf(p, " %u", s->hist[i]);
+    }
+    xprintf("%s\r\n", line);
+}
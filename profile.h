@@ -0,0 +1,39 @@
+/*
+ * File:   profile.h
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include "hal.h"
+
+/* Per task execution time statistics. The scheduler timestamps every TickFct
+ * call and feeds the result to profile_record(). Times are in core timer
+ * cycles, 2 / SYSCLK_HZ each (41.7ns with the 48MHz SYSCLK, see
+ * timestamp.h). Recording is a handful of compares and adds, so it can be
+ * left on in release builds. Comment out PROFILE_TASKS to remove it. */
+#define PROFILE_TASKS
+
+// histogram bin n counts runs of 2^(n-1) to 2^n - 1 cycles, the last bin
+// takes everything longer (2^16 cycles and up, 2.7ms at 48MHz)
+#define PROFILE_HIST_BINS 18
+
+typedef struct {
+    uint32_t count;         // number of calls
+    uint32_t min;           // shortest run
+    uint32_t max;           // longest run
+    uint64_t total;         // sum of all runs, for the mean
+    uint16_t hist[PROFILE_HIST_BINS];   // log2 histogram (saturates)
+} profile_stats;
+
+void profile_reset(profile_stats * s);
+void profile_record(profile_stats * s, uint32_t start, uint32_t end);
+void profile_add(profile_stats * s, uint32_t t);
+uint32_t profile_mean(const profile_stats * s);
+void profile_print(uint32_t id, const profile_stats * s);
+
+#endif // _PROFILE_H
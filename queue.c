@@ -0,0 +1,145 @@
+/*
+ * File:   queue.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#include <string.h>
+
+#include "queue.h"
+
+#define SLOT(q, i) ((q)->slots + ((i) & (q)->mask) * (q)->size)
+
+// --- SINGLE PRODUCER, SINGLE CONSUMER ---
+
+void * spsc_claim(spsc_queue * q){
+    /* The slot at head, if there is room. It is the producer's until
+     * spsc_publish(); claiming again before that gives the same slot. */
+    uint32_t h = q->head;
+    if (h - q->tail > q->mask){
+        q->full++;
+        return 0;
+    }
+    return SLOT(q, h);
+}
+
+void spsc_publish(spsc_queue * q){
+    // the element is written before the consumer can see it
+    __sync_synchronize();
+    q->head++;
+}
+
+uint32_t spsc_put(spsc_queue * q, const void * e){
+    void * s = spsc_claim(q);
+    if (!s){
+        return 0;
+    }
+    memcpy(s, e, q->size);
+    spsc_publish(q);
+    return 1;
+}
+
+void * spsc_peek(spsc_queue * q){
+    /* The oldest element, or 0 if there are none. It stays put until
+     * spsc_release(). */
+    uint32_t t = q->tail;
+    if (t == q->head){
+        return 0;
+    }
+    __sync_synchronize();
+    return SLOT(q, t);
+}
+
+void spsc_release(spsc_queue * q){
+    // done with the element before the producer can have the slot back
+    __sync_synchronize();
+    q->tail++;
+}
+
+uint32_t spsc_get(spsc_queue * q, void * e){
+    void * s = spsc_peek(q);
+    if (!s){
+        return 0;
+    }
+    memcpy(e, s, q->size);
+    spsc_release(q);
+    return 1;
+}
+
+uint32_t spsc_count(const spsc_queue * q){
+    return q->head - q->tail;
+}
+
+// --- MULTIPLE PRODUCERS, SINGLE CONSUMER ---
+
+// the published flag at the start of a slot
+#define PUBLISHED(s) (*(volatile uint32_t *)(s))
+
+void * mpsc_claim(mpsc_queue * q){
+    /* Reserve the slot at head with compare and swap, so a higher level
+     * ISR can claim in the middle of this and get the next one. */
+    uint32_t h;
+    do {
+        h = q->head;
+        if (h - q->tail > q->mask){
+            __sync_fetch_and_add(&q->full, 1);
+            return 0;
+        }
+    } while (!__sync_bool_compare_and_swap(&q->head, h, h + 1));
+    return SLOT(q, h) + q->offset;
+}
+
+void mpsc_publish(mpsc_queue * q, void * e){
+    // e is from mpsc_claim(), its flag is at the start of the slot
+    __sync_synchronize();
+    PUBLISHED((uint8_t *)e - q->offset) = 1;
+}
+
+uint32_t mpsc_put(mpsc_queue * q, const void * e){
+    void * s = mpsc_claim(q);
+    if (!s){
+        return 0;
+    }
+    memcpy(s, e, q->elem);
+    mpsc_publish(q, s);
+    return 1;
+}
+
+void * mpsc_peek(mpsc_queue * q){
+    /* The oldest element, or 0 if there are none, or if the oldest is
+     * claimed but not published yet. */
+    uint32_t t = q->tail;
+    uint8_t * s;
+    if (t == q->head){
+        return 0;
+    }
+    s = SLOT(q, t);
+    if (!PUBLISHED(s)){
+        return 0;
+    }
+    __sync_synchronize();
+    return s + q->offset;
+}
+
+void mpsc_release(mpsc_queue * q){
+    PUBLISHED(SLOT(q, q->tail)) = 0;
+    __sync_synchronize();
+    q->tail++;
+}
+
+uint32_t mpsc_get(mpsc_queue * q, void * e){
+    void * s = mpsc_peek(q);
+    if (!s){
+        return 0;
+    }
+    memcpy(e, s, q->elem);
+    mpsc_release(q);
+    return 1;
+}
+
+uint32_t mpsc_count(const mpsc_queue * q){
+    // includes any claimed and not yet published
+    return q->head - q->tail;
+}
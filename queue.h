@@ -0,0 +1,90 @@
+/*
+ * File:   queue.h
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#ifndef _QUEUE_H
+#define _QUEUE_H
+
+#include "hal.h"
+
+/* Fixed size message queues, to pass samples and events from ISR's to tasks
+ * (or between any two contexts) without a critical section.
+ *
+ * spsc_queue: one producer and one consumer, e.g. one ISR into one task.
+ * Each side only writes its own index, so both are wait free.
+ *
+ * mpsc_queue: any number of producers, at any IPL, and one consumer. A
+ * producer reserves a slot with compare and swap (LL/SC on the M4K), as
+ * debug_log_put() does, and publishes it with a flag in the slot. A slot
+ * that is reserved but not yet published holds up the ones behind it.
+ *
+ * Both hand out slots in place: claim a slot, fill it, publish it; peek at
+ * the oldest, use it, release it. No copy, and the element can be any type.
+ * The _put/_get calls do the same with a copy. Claim returns 0 when the
+ * queue is full, and that is counted (see _full()): drop or retry, as suits.
+ *
+ * Declare a queue at file scope with its storage, statically initialised:
+ *   SPSC_QUEUE(adc_queue, uint16_t, 64);       // 64 must be 2^n
+ * then spsc_put(&adc_queue, &sample) in the ISR and spsc_get() in the task.
+ * A queue is used by reference only; extern spsc_queue adc_queue; to share. */
+
+typedef struct {
+    uint8_t * slots;
+    uint32_t size;              // bytes from one slot to the next
+    uint32_t mask;              // slots - 1
+    volatile uint32_t head;     // next slot to claim, not masked
+    volatile uint32_t tail;     // next slot to consume, not masked
+    volatile uint32_t full;     // claims refused
+} spsc_queue;
+
+typedef struct {
+    uint8_t * slots;            // each a published flag, then the element
+    uint32_t size;
+    uint32_t offset;            // of the element in a slot
+    uint32_t elem;              // sizeof the element, what _put/_get copy
+    uint32_t mask;
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t full;
+} mpsc_queue;
+
+#define QUEUE_POW2_(name, n) \
+    typedef char name##_is_2n[((n) > 0 && ((n) & ((n) - 1)) == 0) ? 1 : -1]
+
+#define SPSC_QUEUE(name, type, n) \
+    QUEUE_POW2_(name, n); \
+    static type name##_slots[n]; \
+    spsc_queue name = { (uint8_t *)name##_slots, sizeof(type), (n) - 1, 0, 0, 0 }
+
+#define MPSC_QUEUE(name, type, n) \
+    QUEUE_POW2_(name, n); \
+    typedef struct { volatile uint32_t published; type e; } name##_slot; \
+    static name##_slot name##_slots[n]; \
+    mpsc_queue name = { (uint8_t *)name##_slots, sizeof(name##_slot), \
+        __builtin_offsetof(name##_slot, e), sizeof(type), (n) - 1, 0, 0, 0 }
+
+// producer side
+void * spsc_claim(spsc_queue * q);
+void spsc_publish(spsc_queue * q);
+uint32_t spsc_put(spsc_queue * q, const void * e);
+// consumer side
+void * spsc_peek(spsc_queue * q);
+void spsc_release(spsc_queue * q);
+uint32_t spsc_get(spsc_queue * q, void * e);
+uint32_t spsc_count(const spsc_queue * q);
+#define spsc_full(q) ((q)->full)
+
+void * mpsc_claim(mpsc_queue * q);
+void mpsc_publish(mpsc_queue * q, void * e);
+uint32_t mpsc_put(mpsc_queue * q, const void * e);
+void * mpsc_peek(mpsc_queue * q);
+void mpsc_release(mpsc_queue * q);
+uint32_t mpsc_get(mpsc_queue * q, void * e);
+uint32_t mpsc_count(const mpsc_queue * q);
+#define mpsc_full(q) ((q)->full)
+
+#endif // _QUEUE_H
@@ -9,93 +9,688 @@
 #include "scheduler.h"
 #include "initialise.h"
 #include "debug_uart.h"
+#include "debug_log.h"
+#include "xprintf.h"
+#include "profile.h"
+#include "timing_wheel.h"
+#include "fast_tier.h"
+#include "trace.h"
+#include "timestamp.h"
+#include "background.h"
+#include "swtimer.h"
 
-#define INCLUDE_TEST_TASKS
+typedef char task_pool_fits_wheel[(SCHEDULER_MAX_TASKS <= WHEEL_MAX_ENTRIES) ? 1 : -1];
 
-#ifdef INCLUDE_TEST_TASKS
-#define NUM_TASKS 6
-#else
-#define NUM_TASKS 4
-#endif
+// task states. Changes made with the API are applied at the start of the
+// next tick, so tasks can add, remove and retime tasks (even themselves).
+#define TASK_FREE       0
+#define TASK_ADDING     1
+#define TASK_ACTIVE     2
+#define TASK_REMOVING   3
 
-typedef struct task {
-   uint32_t  period;         // Rate at which the task should tick
-   uint32_t  elapsedTime;    // Time since task's last tick
+// what a table task is. These are const, so they stay in flash
+typedef struct {
    void (*TickFct)(void);       // Function to call for task's tick
+   uint32_t  period;         // Rate at which the task should tick, at the start
+   uint32_t  offset;         // extra ticks before the first release
+   uint32_t  wcet;           // declared worst case run, Timer 1 counts (0 = measure)
+} task_desc;
+
+// and the state of any task, in RAM
+typedef struct task {
+   uint32_t  period;         // Rate at which the task should tick (can be changed)
+   uint32_t  release;        // Next release tick, when a change is pending
+   uint32_t  misses;         // releases not run on time (overruns)
+   uint8_t   state;          // TASK_FREE etc.
+   uint8_t   low_priority;   // shed first under OVERRUN_SHED
 } task;
 
+// the longest we can stretch one Timer 1 period (PR1 is 16 bits)
+#define TICKLESS_MAX_SKIP (65536 / (SYSTEM_TICK_TIMER + 1) - 1)
+// Timer 1 counts kept clear of TMR1 when PR1 is cut short: written below
+// TMR1, Timer 1 would run on to 0xFFFF and wrap
+#define TICKLESS_PR_MARGIN 4
+
 volatile uint32_t task_scheduler_flag = 0;
 uint32_t system_timer_max = 100; // we make this>0 so some LED flash is always visible
-uint32_t led_counter = 0;
-uint32_t tick_counter = 0;
-
-task tasks[NUM_TASKS]; // task list
+static volatile uint32_t tick_start = 0;    // timestamp of the last Timer1Tick
+static uint32_t busy_max = 0;               // most cycles from a tick to the end of its tasks
+static uint32_t scheduler_ticks = 0; // absolute tick count, wraps
+static uint32_t overrun_policy = OVERRUN_POLICY;
+static void (*overrun_hook)(task_handle running, uint32_t late) = 0;
+static volatile uint32_t running_task = NO_TASK;
+static volatile uint32_t late_ticks = 0;    // ticks that came while the flag was set
+static volatile uint32_t overrun_task = NO_TASK;
+static volatile uint32_t overrun_new = 0;   // not yet passed to the hook
+static volatile uint32_t overruns = 0;
+static uint32_t shed_until = 0;             // OVERRUN_SHED: end of shedding
+#ifdef TICKLESS_IDLE
+static volatile uint32_t skipped_ticks = 0; // ticks the current Timer 1 period covers, less one
+static idle_stats idle;
+#endif
 
-void task_tick_counter(void);
 void task_blink_on(void);
 void task_blink_off(void);
 void task_start_print_timer(void);
 void task_print_two_secs(void);
-void task_load_monitor(void);
+void task_level_load(void);
+void task_profile_dump(void);
+void task_idle_report(void);
+static void load_monitor(void);
+#ifdef INCLUDE_TEST_TASKS
+void task_timer2_event(void);
+static task_handle timer2_event;
+static volatile uint32_t timer2_posted;     // timestamp_now32() in the callback
+static void timer2_demo(void * arg);
+static uint32_t timer2_demo_timer;
+#endif
+
+// the task table entries, handles ID_<fn> (scheduler.h)
+#define TABLE_MASK ((wheel_mask)((1ULL << NUM_TABLE_TASKS) - 1))
+
+// compile time checks on the table
+#define TASK(fn, period, offset, wcet, chars) \
+    typedef char period_ok_##fn[((period) > 0 && (period) <= 0x7FFFFFFF) ? 1 : -1];
+#include "task_table.h"
+#undef TASK
+
+// the task table, in flash
+static const task_desc task_table[NUM_TABLE_TASKS] = {
+#define TASK(fn, period, offset, wcet, chars) { &fn, (period), (offset), (wcet) },
+#include "task_table.h"
+#undef TASK
+};
+
+// RAM state, zeroed (.bss) so all free: init_scheduler() fills in the table
+// tasks from task_table[]
+task tasks[SCHEDULER_MAX_TASKS];
+static wheel_mask pending = 0;              // tasks with a change to apply
+static volatile wheel_mask events = 0;      // tasks posted, not yet run
+#ifdef PROFILE_TASKS
+static profile_stats task_stats[SCHEDULER_MAX_TASKS];   // Execution time of TickFct
+#endif
+
+// what the tasks added at run time are, from handle NUM_TABLE_TASKS on
+static void (*pool_fn[SCHEDULER_POOL_TASKS])(void);
+static uint32_t pool_wcet[SCHEDULER_POOL_TASKS];
 
 void init_scheduler(void){
-    // just inc the system counter
-    tasks[0].elapsedTime = 0;
-    tasks[0].period = 1; //
-    tasks[0].TickFct = &task_tick_counter;
-    // turn on blink LED (about every second))
-    tasks[1].elapsedTime = 0;
-    tasks[1].period = (SYSTEM_TICK_TIMER / 16 ); // just over 1s
-    tasks[1].TickFct = &task_blink_on;
-    // see if the LED should turn off
-    tasks[2].elapsedTime = 0;
-    tasks[2].period = 1; // 
-    tasks[2].TickFct = &task_blink_off;
-    
+    /* Called once at start up, before the first tick. The table tasks start
+     * out being added, first released period + offset ticks in, and go into
+     * the wheel on the first tick as pending changes. */
+    uint32_t t;
+    for (t = 0; t < NUM_TABLE_TASKS; t++){
+        tasks[t].period = task_table[t].period;
+        tasks[t].release = scheduler_ticks + task_table[t].period + task_table[t].offset;
+        tasks[t].state = TASK_ADDING;
+        tasks[t].low_priority = 0;
+        tasks[t].misses = 0;
+#ifdef PROFILE_TASKS
+        profile_reset(&task_stats[t]);
+#endif
+    }
+    pending |= TABLE_MASK;
+    wheel_init();
+    init_fast_tier();
 #ifdef INCLUDE_TEST_TASKS
-    // these tasks are for test/demo purposes. You can remove them if
-    // not needed.
-    
-    // Start T2 which will raise an int and print something, every 10 secs
-    tasks[3].elapsedTime = 0;
-    tasks[3].period = 400;
-    tasks[3].TickFct = &task_start_print_timer; 
-    // just print a boring message every two secs
-    tasks[4].elapsedTime = 0;
-    tasks[4].period = 200;
-    tasks[4].TickFct = &task_print_two_secs; 
-#endif
-    
-    // monitor system worst case load (used to control blink LED)
-    // this should run last
-    tasks[NUM_TASKS - 1].elapsedTime = 0;
-    tasks[NUM_TASKS - 1].period = 1; 
-    tasks[NUM_TASKS - 1].TickFct = &task_load_monitor; 
+    timer2_event = scheduler_add_event_task(task_timer2_event);
+    timer2_demo_timer = swtimer_add(timer2_demo, 0);
+#endif
+}
+
+// --- TASK POOL ---
+
+static uint32_t now_ticks(void){
+    /* scheduler_ticks, plus the ticks that have gone by in a stretched
+     * Timer 1 period. In dead time that is the tick the next interrupt would
+     * start were the period not stretched, so a change made then is from
+     * the real time, not from when the CPU went to sleep. */
+#ifdef TICKLESS_IDLE
+    uint32_t s, n, count;
+    s = hal_irq_save();
+    n = skipped_ticks;
+    if (n){
+        count = hal_tick_timer_count();
+        // once the tick is due, run_scheduler() adds all of them
+        if (!task_scheduler_flag && !hal_tick_timer_pending()
+                && count / (SYSTEM_TICK_TIMER + 1) < n){
+            n = count / (SYSTEM_TICK_TIMER + 1);
+        }
+    }
+    hal_irq_restore(s);
+    return scheduler_ticks + n;
+#else
+    return scheduler_ticks;
+#endif
+}
+
+task_handle scheduler_add_task(void (*fn)(void), uint32_t period, uint32_t offset){
+    /* Take a free entry from the pool. The task is first released period +
+     * offset ticks from now, then every period. Running out of pool is a
+     * configuration fault, so it is fatal. The table tasks' entries are
+     * theirs, even once removed. */
+    uint32_t t;
+    if (fn == 0 || period == 0){
+        fatal_error("Bad task.", period);
+    }
+    for (t = NUM_TABLE_TASKS; t < SCHEDULER_MAX_TASKS; ++t) {
+        if (tasks[t].state == TASK_FREE){
+            pool_fn[t - NUM_TABLE_TASKS] = fn;
+            pool_wcet[t - NUM_TABLE_TASKS] = 0;
+            tasks[t].period = period;
+            tasks[t].release = now_ticks() + period + offset;
+            tasks[t].state = TASK_ADDING;
+            tasks[t].low_priority = 0;
+            tasks[t].misses = 0;
+#ifdef PROFILE_TASKS
+            profile_reset(&task_stats[t]);
+#endif
+            pending |= (wheel_mask)1 << t;
+            return t;
+        }
+    }
+    fatal_error("Task pool full.", SCHEDULER_MAX_TASKS);
+    return 0;
+}
+
+task_handle scheduler_add_event_task(void (*fn)(void)){
+    /* A task with no period, only run when posted. It never goes in the
+     * wheel, so it is active at once rather than on the next tick. */
+    task_handle h = scheduler_add_task(fn, 1, 0);
+    tasks[h].period = 0;
+    tasks[h].state = TASK_ACTIVE;
+    pending &= ~((wheel_mask)1 << h);
+    return h;
+}
+
+void scheduler_post_event(task_handle h){
+    /* Mark the task ready, from anywhere: ISR's of any level, the fast
+     * tier, tasks. It runs once however many times it is posted before it
+     * gets to run. */
+    if (h >= SCHEDULER_MAX_TASKS){
+        fatal_error("Bad task handle.", h);
+    }
+    __sync_fetch_and_or(&events, (wheel_mask)1 << h);
+}
+
+static void check_handle(task_handle h){
+    if (h >= SCHEDULER_MAX_TASKS || tasks[h].state == TASK_FREE
+            || tasks[h].state == TASK_REMOVING){
+        fatal_error("Bad task handle.", h);
+    }
+}
+
+void scheduler_remove_task(task_handle h){
+    check_handle(h);
+    tasks[h].state = TASK_REMOVING;
+    pending |= (wheel_mask)1 << h;
+}
+
+void scheduler_set_period(task_handle h, uint32_t period){
+    /* The task is next released one new period from now. */
+    check_handle(h);
+    if (period == 0){
+        fatal_error("Bad task period.", h);
+    }
+    if (tasks[h].period == 0){
+        fatal_error("Event task has no period.", h);
+    }
+    tasks[h].period = period;
+    tasks[h].release = now_ticks() + period;
+    pending |= (wheel_mask)1 << h;
+}
+
+void scheduler_set_low_priority(task_handle h, uint32_t low){
+    check_handle(h);
+    tasks[h].low_priority = low;
+}
+
+void scheduler_set_phase(task_handle h, uint32_t phase){
+    /* The next release is the first tick from the next one on that is in
+     * phase. */
+    uint32_t next = now_ticks() + 1;
+    check_handle(h);
+    if (tasks[h].period == 0){
+        fatal_error("Event task has no phase.", h);
+    }
+    phase %= tasks[h].period;
+    tasks[h].release = next + (phase + tasks[h].period - next % tasks[h].period) % tasks[h].period;
+    pending |= (wheel_mask)1 << h;
+}
+
+void scheduler_set_wcet(task_handle h, uint32_t counts){
+    check_handle(h);
+    if (h < NUM_TABLE_TASKS){
+        fatal_error("Table task WCET is set in task_table.h.", h);
+    }
+    pool_wcet[h - NUM_TABLE_TASKS] = counts;
+}
+
+// --- LOAD LEVELLING ---
+
+static uint32_t level_wcet(uint32_t t){
+    uint32_t wcet = (t < NUM_TABLE_TASKS) ? task_table[t].wcet : pool_wcet[t - NUM_TABLE_TASKS];
+    if (wcet){
+        return wcet;
+    }
+#ifdef PROFILE_TASKS
+    if (task_stats[t].count){
+        return timestamp_to_tick_counts(task_stats[t].max);
+    }
+#endif
+    return 1; // not known, still worth spreading
+}
+
+// the load window, on the stack of scheduler_peak_load() or
+// scheduler_level_load() only while it runs
+typedef struct {
+    uint16_t load[LEVEL_TICKS];     // predicted counts per tick, from the next
+    uint32_t ticks;                 // of load[] in use
+} level_window;
+
+static uint32_t level_live(uint32_t t){
+    // event tasks have no release to level
+    return (tasks[t].state == TASK_ADDING || tasks[t].state == TASK_ACTIVE)
+            && tasks[t].period;
+}
+
+static uint32_t level_peak(const level_window * lw, uint32_t first, uint32_t period, uint32_t w){
+    /* The worst tick if a task of w counts released at first, first +
+     * period ... (ticks from the next) */
+    uint32_t r, peak = 0;
+    for (r = first; r < lw->ticks; r += period){
+        if (lw->load[r] + w > peak){
+            peak = lw->load[r] + w;
+        }
+    }
+    return peak;
+}
+
+static void level_add(level_window * lw, uint32_t first, uint32_t period, uint32_t w){
+    uint32_t r;
+    for (r = first; r < lw->ticks; r += period){
+        uint32_t l = lw->load[r] + w;
+        lw->load[r] = (l > 0xFFFF) ? 0xFFFF : l;
+    }
+}
+
+static void level_clear(level_window * lw){
+    /* The window is the hyperperiod of the live tasks, as long as it is no
+     * more than LEVEL_TICKS; else LEVEL_TICKS. */
+    uint32_t r, t, h = 1;
+    for (t = 0; t < SCHEDULER_MAX_TASKS && h <= LEVEL_TICKS; t++){
+        if (level_live(t)){
+            uint32_t a = h, b = tasks[t].period;
+            while (b){ // a = gcd(h, period)
+                r = a % b;
+                a = b;
+                b = r;
+            }
+            // and h = lcm(h, period), unless that is too many ticks
+            h = (tasks[t].period / a > LEVEL_TICKS) ? LEVEL_TICKS + 1 : h / a * tasks[t].period;
+        }
+    }
+    lw->ticks = (h > LEVEL_TICKS) ? LEVEL_TICKS : h;
+    for (r = 0; r < lw->ticks; r++){
+        lw->load[r] = 0;
+    }
+}
+
+uint32_t scheduler_peak_load(void){
+    level_window lw;
+    uint32_t t, next = now_ticks() + 1;
+    level_clear(&lw);
+    for (t = 0; t < SCHEDULER_MAX_TASKS; t++){
+        if (level_live(t)){
+            uint32_t rel = (pending & ((wheel_mask)1 << t)) ? tasks[t].release : wheel_release(t);
+            while ((int32_t)(rel - next) < 0){ // due this tick, not run yet
+                rel += tasks[t].period;
+            }
+            level_add(&lw, rel - next, tasks[t].period, level_wcet(t));
+        }
+    }
+    return level_peak(&lw, 0, 1, 0);
+}
+
+uint32_t scheduler_level_load(void){
+    /* Place the tasks one at a time, longest WCET first, each at the offset
+     * (within one period) that gives the lightest worst tick so far. The
+     * new phases take effect on the next tick, like any other change. */
+    level_window lw;
+    uint32_t order[SCHEDULER_MAX_TASKS];
+    uint32_t n = 0, i, j, t, next = now_ticks() + 1;
+    for (t = 0; t < SCHEDULER_MAX_TASKS; t++){
+        if (level_live(t)){
+            // insertion sort, longest first, then shortest period
+            for (i = n; i > 0; i--){
+                uint32_t u = order[i - 1];
+                if (level_wcet(u) > level_wcet(t) || (level_wcet(u) == level_wcet(t)
+                        && tasks[u].period <= tasks[t].period)){
+                    break;
+                }
+                order[i] = u;
+            }
+            order[i] = t;
+            n++;
+        }
+    }
+    level_clear(&lw);
+    for (i = 0; i < n; i++){
+        uint32_t best = 0, best_peak = 0xFFFFFFFF;
+        uint32_t span = tasks[order[i]].period;
+        t = order[i];
+        if (span > lw.ticks){
+            span = lw.ticks;
+        }
+        for (j = 0; j < span; j++){
+            uint32_t p = level_peak(&lw, j, tasks[t].period, level_wcet(t));
+            if (p < best_peak){
+                best_peak = p;
+                best = j;
+            }
+        }
+        level_add(&lw, best, tasks[t].period, level_wcet(t));
+        tasks[t].release = next + best;
+        pending |= (wheel_mask)1 << t;
+    }
+    return level_peak(&lw, 0, 1, 0);
+}
+
+static void apply_changes(void){
+    /* A release that has gone by would never come off the wheel, which only
+     * takes the tasks due on the tick it is at: it is run on this tick. */
+    wheel_mask m = pending;
+    pending = 0;
+    while (m) {
+        uint32_t t = wheel_first(m);
+        m &= m - 1;
+        if ((int32_t)(tasks[t].release - scheduler_ticks) < 0){
+            tasks[t].release = scheduler_ticks;
+        }
+        switch (tasks[t].state) {
+        case TASK_ADDING:
+            tasks[t].state = TASK_ACTIVE;
+            wheel_insert(t, tasks[t].release);
+            break;
+        case TASK_ACTIVE:   // new period
+            wheel_remove(t);
+            wheel_insert(t, tasks[t].release);
+            break;
+        case TASK_REMOVING:
+            // harmless if it never made it into the wheel, the bit is ours
+            wheel_remove(t);
+            __sync_fetch_and_and(&events, ~((wheel_mask)1 << t));
+            tasks[t].state = TASK_FREE;
+            break;
+        }
+    }
+}
+
+// --- SCHEDULER ---
+
+static wheel_mask catch_up(void){
+    /* After an overrun, late_ticks ticks have come since this one was
+     * due; the last of them is now. Returns the tasks that are late. */
+    wheel_mask late = 0;
+    uint32_t n;
+    hal_disable_interrupts();
+    n = late_ticks;
+    if (n == 0){
+        hal_enable_interrupts();
+        return 0;
+    }
+    if (overrun_policy == OVERRUN_COUNT){
+        // run the missed ticks one by one, all late but the last
+        late_ticks = n - 1;
+        hal_enable_interrupts();
+        return (n > 1) ? wheel_take_due(scheduler_ticks) : 0;
+    }
+    // OVERRUN_SKIP, OVERRUN_SHED: fold them into this tick
+    late_ticks = 0;
+    hal_enable_interrupts();
+    while (--n){
+        late |= wheel_take_due(scheduler_ticks);
+        scheduler_ticks++;
+    }
+    if (overrun_policy == OVERRUN_SHED){
+        shed_until = scheduler_ticks + OVERRUN_SHED_TICKS;
+    }
+    return late;
+}
+
+static void run_task(uint32_t t){
+    void (*fn)(void) = (t < NUM_TABLE_TASKS) ? task_table[t].TickFct : pool_fn[t - NUM_TABLE_TASKS];
+    running_task = t;
+    trace_event(TRACE_TASK_START, t, scheduler_ticks);
+#ifdef PROFILE_TASKS
+    uint32_t start = timestamp_now32();
+    fn(); // Go
+    profile_record(&task_stats[t], start, timestamp_now32());
+#else
+    fn(); // Go
+#endif
+    trace_event(TRACE_TASK_END, t, 0);
+}
+
+uint32_t scheduler_run_events(void){
+    /* Run the tasks posted since the last call, lowest handle first. From
+     * the main loop in dead time, so a posted task runs within microseconds
+     * rather than on the next tick; and the tick runs any left over. A task
+     * removed since it was posted does not run. Returns the number run. */
+    wheel_mask ev = __sync_fetch_and_and(&events, 0);
+    uint32_t n = 0;
+    while (ev){
+        uint32_t t = wheel_first(ev);
+        ev &= ev - 1;
+        if (tasks[t].state == TASK_ACTIVE){
+            run_task(t);
+            n++;
+        }
+    }
+    running_task = NO_TASK;
+    return n;
 }
 
 void run_scheduler(void){
-    uint32_t  t;
-    for (t = 0; t < NUM_TASKS; ++t) {
-         if (tasks[t].elapsedTime >= tasks[t].period) { // Ready
-            tasks[t].TickFct(); // Go
-            tasks[t].elapsedTime = 0;
-         }
-         tasks[t].elapsedTime++;
-      }
-    task_scheduler_flag = 0;
+    /* Only the tasks due on this tick are touched. They come off the wheel
+     * in list order, run, and go back in one period later. */
+    wheel_mask due, late;
+    uint32_t shed;
+#ifdef TICKLESS_IDLE
+    // catch up the ticks we slept through, nothing was due in them
+    scheduler_ticks += skipped_ticks;
+    idle.ticks += skipped_ticks + 1;
+    skipped_ticks = 0;
+#endif
+    if (overrun_new){
+        overrun_new = 0;
+        if (overrun_hook){
+            overrun_hook(overrun_task, late_ticks);
+        }
+    }
+    if (pending) {
+        apply_changes();
+    }
+    late = catch_up();
+    due = late | wheel_take_due(scheduler_ticks);
+    shed = (int32_t)(shed_until - scheduler_ticks) > 0;
+    while (due) {
+        uint32_t t = wheel_first(due);
+        due &= due - 1;
+        if (shed && tasks[t].low_priority){
+            tasks[t].misses++;
+        } else {
+            if (late & ((wheel_mask)1 << t)){
+                tasks[t].misses++;
+            }
+            run_task(t);
+        }
+        wheel_insert(t, scheduler_ticks + tasks[t].period);
+    }
+    running_task = NO_TASK;
+    scheduler_run_events();
+    load_monitor();
+    scheduler_ticks++;
+    hal_disable_interrupts();
+    if (late_ticks == 0){
+        task_scheduler_flag = 0;
+    } // else leave it set, and the main loop runs the next tick at once
+    hal_enable_interrupts();
 }
 
 uint32_t timer_tick(void){
     return task_scheduler_flag;
 }
 
-// --- TASKS ---
+uint32_t scheduler_now(void){
+    return now_ticks();
+}
+
+uint32_t scheduler_time_remaining(void){
+    /* Timer 1 counts left before the next tick interrupt, from TMR1 against
+     * PR1; 0 if it is already due or this tick's tasks have not run yet.
+     * TMR1 is read first, so a roll over just after it shows as due. */
+    uint32_t count = hal_tick_timer_count();
+    uint32_t period = hal_tick_timer_period();
+    if (task_scheduler_flag || hal_tick_timer_pending() || count >= period){
+        return 0;
+    }
+    return period - count;
+}
+
+void scheduler_idle(void){
+    /* Called from the main loop in dead time. If the tick is done, no event
+     * or background job is waiting and the debug print, log and trace have
+     * drained, stretch the Timer 1 period over any ticks with nothing due
+     * and WAIT. Interrupts stay off from the check to the WAIT so a tick
+     * cannot slip in between; the CPU still wakes for it. */
+#ifdef TICKLESS_IDLE
+    uint32_t before, after, period;
+    hal_disable_interrupts();
+    if (task_scheduler_flag || hal_tick_timer_pending() || events || background_pending()
+            || debug_print_pending() || debug_log_pending() || trace_pending()){
+        hal_enable_interrupts();
+        return;
+    }
+    if (skipped_ticks && pending){
+        // a change made in a stretched period: end it with the tick it is in
+        // (or the next, if TMR1 might pass PR1 before it is written)
+        uint32_t count = hal_tick_timer_count();
+        uint32_t n = count / (SYSTEM_TICK_TIMER + 1);
+        if (count + TICKLESS_PR_MARGIN >= (n + 1) * (SYSTEM_TICK_TIMER + 1)){
+            n++;
+        }
+        if (n < skipped_ticks){
+            skipped_ticks = n;
+            hal_tick_timer_set_period((n + 1) * (SYSTEM_TICK_TIMER + 1) - 1);
+        }
+    }
+    if (skipped_ticks == 0 && pending == 0){
+        // scheduler_ticks is the tick the next interrupt starts
+        uint32_t n = wheel_next_due(scheduler_ticks, TICKLESS_MAX_SKIP) - scheduler_ticks;
+        if (n){
+            skipped_ticks = n;
+            hal_tick_timer_set_period((n + 1) * (SYSTEM_TICK_TIMER + 1) - 1);
+        }
+    }
+    period = hal_tick_timer_period() + 1;
+    before = hal_tick_timer_count();
+    hal_cpu_idle();
+    after = hal_tick_timer_count();
+    idle.wakeups++;
+    if (hal_tick_timer_pending()){ // woken by the tick, TMR1 has rolled over
+        after += period;
+    }
+    idle.idle_counts += after - before;
+    hal_enable_interrupts();
+#endif
+}
 
-void task_tick_counter(void){
-    //DEBUG_PIN = 1;
-    tick_counter++;
-    //DEBUG_PIN = 0;
+#ifdef TICKLESS_IDLE
+void scheduler_idle_stats(idle_stats * s, uint32_t reset){
+    hal_disable_interrupts();
+    *s = idle;
+    if (reset){
+        idle.wakeups = 0;
+        idle.idle_counts = 0;
+        idle.ticks = 0;
+    }
+    hal_enable_interrupts();
 }
+#endif
+
+void scheduler_set_overrun_policy(uint32_t policy){
+    if (policy > OVERRUN_SHED){
+        fatal_error("Bad overrun policy.", policy);
+    }
+    overrun_policy = policy;
+}
+
+uint32_t scheduler_overrun_policy(void){
+    return overrun_policy;
+}
+
+void scheduler_set_overrun_hook(void (*hook)(task_handle running, uint32_t late)){
+    overrun_hook = hook;
+}
+
+uint32_t scheduler_overruns(void){
+    return overruns;
+}
+
+uint32_t scheduler_task_misses(uint32_t t){
+    if (t >= SCHEDULER_MAX_TASKS || tasks[t].state == TASK_FREE){
+        return 0;
+    }
+    return tasks[t].misses;
+}
+
+uint32_t scheduler_num_tasks(void){
+    return SCHEDULER_MAX_TASKS;
+}
+
+uint32_t scheduler_task_active(uint32_t t){
+    return t < SCHEDULER_MAX_TASKS && tasks[t].state != TASK_FREE
+            && tasks[t].state != TASK_REMOVING;
+}
+
+uint32_t scheduler_task_period(uint32_t t){
+    if (!scheduler_task_active(t)){
+        return 0;
+    }
+    return tasks[t].period;
+}
+
+#ifdef PROFILE_TASKS
+const profile_stats * scheduler_task_profile(uint32_t t){
+    if (t >= SCHEDULER_MAX_TASKS || tasks[t].state == TASK_FREE){
+        return 0;
+    }
+    return &task_stats[t];
+}
+#endif
+
+void scheduler_profile_reset(void){
+#ifdef PROFILE_TASKS
+    uint32_t t;
+    for (t = 0; t < SCHEDULER_MAX_TASKS; ++t) {
+        profile_reset(&task_stats[t]);
+    }
+#endif
+}
+
+void scheduler_stats_reset(void){
+    uint32_t t;
+    scheduler_profile_reset();
+    for (t = 0; t < SCHEDULER_MAX_TASKS; ++t) {
+        tasks[t].misses = 0;
+    }
+    overruns = 0;
+    busy_max = 0;
+    system_timer_max = 0;
+}
+
+// --- TASKS ---
 
 // we use the blink LED to give an idea of system load
 // the period is about 1 second
@@ -103,37 +698,91 @@ void task_tick_counter(void){
 // complete all tasks
 
 void task_blink_on(void){
+    uint32_t max_elapsed_time = system_timer_max;
+    max_elapsed_time = max_elapsed_time >> 4; // divide by 16
+    if (max_elapsed_time == 0){
+        max_elapsed_time = 1;
+    }
     RUN_LED = 1;
-    led_counter = 0;
+    scheduler_set_period(ID_task_blink_off, max_elapsed_time);
 }
 
 void task_blink_off(void){
-    uint32_t max_elapsed_time = system_timer_max;
-    max_elapsed_time = max_elapsed_time >> 4; // divide by 16
-    led_counter++;
-    if (led_counter >= max_elapsed_time){
-        RUN_LED = 0;
-    }
+    /* Runs once per blink, then parks itself until task_blink_on() wants
+     * it again. No polling every tick, so the tickless idle can sleep. */
+    RUN_LED = 0;
+    scheduler_set_period(ID_task_blink_off, 2 * BLINK_PERIOD);
 }
 
-void task_load_monitor(void){
+static void load_monitor(void){
     /*
-     * This should be the last task in the list. We see how close we are
-     * to running out out of time in the task manager.
+     * Called by run_scheduler() after the last task of the tick. We see how
+     * close we are to running out out of time in the task manager. Timed
+     * from Timer1Tick, so the interrupt latency is not in it.
      */
-    uint32_t sys_timer = TMR1;
+    uint32_t busy = timestamp_now32() - tick_start;
+    uint32_t sys_timer = timestamp_to_tick_counts(busy);
+    if (busy > busy_max){
+        busy_max = busy;
+    }
     if (sys_timer > system_timer_max){
         system_timer_max = sys_timer;
     }
 }
 
+uint32_t scheduler_busy_max(uint32_t reset){
+    uint32_t b = busy_max;
+    if (reset){
+        busy_max = 0;
+    }
+    return b;
+}
+
+uint32_t scheduler_tick_max(void){
+    return system_timer_max;
+}
+
+void task_profile_dump(void){
+    /* Print the execution time stats of one task per call, so we never put
+     * more than a line into the debug buffer at a time. */
+#ifdef PROFILE_TASKS
+    static uint32_t t = 0;
+    uint32_t n;
+    for (n = 0; n < SCHEDULER_MAX_TASKS; n++){
+        if (t >= SCHEDULER_MAX_TASKS){
+            t = 0;
+        }
+        if (tasks[t].state == TASK_ACTIVE){
+            profile_print(t, &task_stats[t]);
+            t++;
+            return;
+        }
+        t++;
+    }
+#endif
+}
+
+void task_idle_report(void){
+    /* Tickless idle: wakeups per second and the percentage of time asleep,
+     * since the last report. */
+#ifdef TICKLESS_IDLE
+    idle_stats s;
+    scheduler_idle_stats(&s, 1);
+    if (s.ticks){
+        xprintf("I %u wake/s %u%% idle\r\n",
+                s.wakeups * SYSTEM_TICKS_PER_SEC / s.ticks,
+                s.idle_counts / (s.ticks * (SYSTEM_TICK_TIMER + 1) / 100));
+    }
+#endif
+}
+
 // --- UTILITY FUNCTIONS ---
 
 void fatal_error(int8_t * msg, int32_t e ){
     /*
      * All errors are fatal. We turn on the LED and complain on the debug port
      */
-    __builtin_disable_interrupts();
+    hal_disable_interrupts();
     int32_t i = 0;
     RUN_LED = 1;
     while(1){
@@ -141,7 +790,8 @@ void fatal_error(int8_t * msg, int32_t e ){
         xprintf(msg);
         xprintf("\r\n");
         for (i = 0; i < 1000000;i++){
-            debug_print_char();
+            debug_log_drain();
+            debug_print_poll();
         }
     }
 }
@@ -150,49 +800,113 @@ void fatal_error(int8_t * msg, int32_t e ){
 
 void __ISR(_TIMER_1_VECTOR, IPL1AUTO) Timer1Tick(void){
     /* TIMER 1 generates 5ms ticks for the Task Scheduler */
-    if(task_scheduler_flag){ // fatal error, tasks did not complete
-        fatal_error("Scheduler Overrun Error.", 0);
+    trace_event(TRACE_ISR_ENTER, TRACE_ISR_TIMER1, 0);
+    // this also keeps the 64 bit timestamp going, it must be read every 89s
+    tick_start = (uint32_t)timestamp_now();
+    if(task_scheduler_flag){ // overrun, tasks did not complete
+        if (overrun_policy == OVERRUN_FATAL){
+            fatal_error("Scheduler Overrun Error.", 0);
+        }
+        if (late_ticks == 0){
+            overrun_task = running_task;
+            overrun_new = 1;
+        }
+        late_ticks++;
+        overruns++;
     } else {
         task_scheduler_flag = 1;
     }
-    IFS0bits.T1IF = 0; // reset the flag
+#ifdef TICKLESS_IDLE
+    if (skipped_ticks){ // end of a stretched period, back to one tick
+        hal_tick_timer_set_period(SYSTEM_TICK_TIMER);
+    }
+#endif
+    hal_tick_timer_ack(); // reset the flag
+    trace_event(TRACE_ISR_EXIT, TRACE_ISR_TIMER1, 0);
 }
 
 #ifdef INCLUDE_TEST_TASKS
 // TASKS and ISR for test / demo purposes
 
 void task_start_print_timer(void){
-    /* This task starts Timer 2 which times out and raises an interrupt. The 
-     * timeout interval is about 35us to 200us to interrupt the debug print from  
-     * the next task_print_two_secs(). Hence we can test that the debug print
-     * can cope with writes from different interrupt priorities.  */
-    static uint32_t timeout_interval = 20;
-    T2CONbits.ON = 0;
-    TMR2 = 0; 
-    PR2 = timeout_interval;
-    timeout_interval += 3;
-    if (timeout_interval > 150){
-        timeout_interval = 20;
+    /* This task starts a one shot software timer (Timer 2) which times out
+     * and calls back at IPL2. The timeout is 27us to 199us to interrupt the
+     * debug print from the next task_print_two_secs(). Hence we can test
+     * that the debug print can cope with writes from different interrupt
+     * priorities.  */
+    static uint32_t timeout_us = 27;
+    swtimer_start(timer2_demo_timer, timeout_us, 0);
+    timeout_us += 4;
+    if (timeout_us > 200){
+        timeout_us = 27;
         // while(1); // uncomment to show error handling after 40 ticks!
     }
-    T2CONbits.ON = 1;
     DEBUG_PIN = 1;
 }
 
+void task_timer2_event(void){
+    /* Event task, posted by timer2_demo(). Prints how long it took to get
+     * here from the ISR. */
+    uint32_t latency = timestamp_now32() - timer2_posted;
+    xprintf("E %u ns\r\n", (uint32_t)timestamp_to_ns(latency));
+}
+
+// background job demo: CRC-32 of the start of program flash, as an image
+// check would do, a chunk per call
+#define CRC_DEMO_BYTES 8192
+#define CRC_DEMO_CHUNK 256
+typedef char crc_demo_ok[(CRC_DEMO_BYTES % CRC_DEMO_CHUNK == 0) ? 1 : -1];
+
+static uint32_t job_crc_demo(void * arg){
+    static uint32_t pos = 0, crc = 0xFFFFFFFF;
+    const uint8_t * flash = hal_flash_base();
+    uint32_t i, b;
+    (void)arg;
+    for (i = 0; i < CRC_DEMO_CHUNK; i++, pos++){
+        crc ^= flash[pos];
+        for (b = 0; b < 8; b++){
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    if (pos < CRC_DEMO_BYTES){
+        return 1;
+    }
+    xprintf("C %08x, %u chunks so far\r\n", ~crc, background_chunks() + 1);
+    pos = 0;
+    crc = 0xFFFFFFFF;
+    return 0;
+}
+
 void task_print_two_secs(void){
-    /* Here we just print a string to debug terminal. */
-    xprintf("=============%d\r\n", tick_counter);
+    /* Here we just print a string to debug terminal, and start the
+     * background job demo again. */
+    xprintf("=============%d\r\n", scheduler_now());
+    if (!background_pending()){
+        background_add(job_crc_demo, 0, 0);
+    }
+}
+
+void task_level_load(void){
+    /* Go, then level the load from the WCETs and print the predicted worst
+     * tick before and after (Timer 1 counts). Removed first, so its own
+     * long run, which never comes again, is not part of the load. */
+    uint32_t before;
+    scheduler_remove_task(ID_task_level_load);
+    before = scheduler_peak_load();
+    xprintf("L peak %u -> %u\r\n", before, scheduler_level_load());
 }
 
-void __ISR(_TIMER_2_VECTOR, IPL2AUTO) Timer2Tick(void){
-    /* TIMER 2 prints a debug count and turns itself off (one-shot timer). 
+static void timer2_demo(void * arg){
+    /* The software timer callback, in the Timer 2 ISR, prints a debug count.
      * This is to prove that debug prints can work from ISR's. The count is 
-     * so we can see if a print was missed. */
+     * so we can see if a print was missed. It is a deferred print, so the
+     * formatting is done later in dead time, not at IPL2. */
     static uint32_t count = 0;
+    (void)arg;
+    timer2_posted = timestamp_now32();
+    scheduler_post_event(timer2_event);
     DEBUG_PIN = 0;
-    xprintf("*T%d*", count);
-    T2CONbits.ON = 0;           // timer off
+    debug_log("*T%d*", count);
     count++;
-    IFS0bits.T2IF = 0; // reset the flag
 }
 #endif
\ No newline at end of file
@@ -9,12 +9,126 @@
 #ifndef _SCHEDULER_H 
 #define _SCHEDULER_H
 
-#include <xc.h>
+#include "hal.h"
+#include "profile.h"
+
+// Sleep (CPU idle) between deadlines, stretching the Timer 1 period over ticks
+// with nothing due. Comment out for the original busy polling main loop.
+#define TICKLESS_IDLE
+
+// build the test/demo tasks (see task_table.h)
+#define INCLUDE_TEST_TASKS
+
+// run LED blinks every BLINK_PERIOD ticks, just over 1s
+#define BLINK_PERIOD (SYSTEM_TICK_TIMER / 16)
+
+// the task pool: an entry for each task_table.h task, which gets handle
+// ID_<fn>, and SCHEDULER_POOL_TASKS for the tasks added at run time (the
+// demo and console event tasks, and two spare). At most 32 in all, one bit
+// each in the wheel.
+#ifndef SCHEDULER_POOL_TASKS
+#define SCHEDULER_POOL_TASKS 4
+#endif
+
+enum {
+#define TASK(fn, period, offset, wcet, chars) ID_##fn,
+#include "task_table.h"
+#undef TASK
+    NUM_TABLE_TASKS
+};
+#define SCHEDULER_MAX_TASKS (NUM_TABLE_TASKS + SCHEDULER_POOL_TASKS)
+
+typedef uint32_t task_handle;
+
+// What happens when a tick comes round before run_scheduler() has finished
+// the last one. Set at run time with scheduler_set_overrun_policy().
+#define OVERRUN_FATAL   0   // fatal_error(), the original behaviour
+#define OVERRUN_COUNT   1   // count it and run the missed ticks late, back to back
+#define OVERRUN_SKIP    2   // run the missed ticks as one, each task due in them once
+#define OVERRUN_SHED    3   // as OVERRUN_SKIP, and low priority tasks are not run
+                            // for OVERRUN_SHED_TICKS ticks
+#define OVERRUN_POLICY  OVERRUN_FATAL
+#define OVERRUN_SHED_TICKS 20
+
+// the running task passed to the overrun hook, when the overrun was not in one
+#define NO_TASK SCHEDULER_MAX_TASKS
 
 void fatal_error(int8_t * msg, int32_t i);
 void init_scheduler(void);
 void run_scheduler(void);
 uint32_t timer_tick(void);
+uint32_t scheduler_now(void);
+// Timer 1 counts before the next tick, for work in dead time (background.h)
+uint32_t scheduler_time_remaining(void);
+void scheduler_idle(void);
+
+#ifdef TICKLESS_IDLE
+typedef struct {
+    uint32_t wakeups;       // times the CPU came out of WAIT
+    uint32_t idle_counts;   // Timer 1 counts spent in WAIT
+    uint32_t ticks;         // scheduler ticks covered, slept through or not
+} idle_stats;
+void scheduler_idle_stats(idle_stats * s, uint32_t reset);
+#endif
+
+// add/remove/retime tasks at any time from main or a task (not from ISR's).
+// Changes take effect on the next tick. Bad handles are fatal, and so is
+// retiming an event task, which has no period to change.
+task_handle scheduler_add_task(void (*fn)(void), uint32_t period, uint32_t offset);
+void scheduler_remove_task(task_handle h);
+void scheduler_set_period(task_handle h, uint32_t period);
+void scheduler_set_low_priority(task_handle h, uint32_t low);
+// release on the ticks where scheduler_now() % period == phase
+void scheduler_set_phase(task_handle h, uint32_t phase);
+
+// event tasks run when posted, not by period. scheduler_post_event() marks
+// one ready from anywhere (ISR's of any level included), and the main loop
+// runs it in dead time, within microseconds; the tick runs any left over.
+// Periodic tasks can be posted too, for an extra run.
+task_handle scheduler_add_event_task(void (*fn)(void));
+void scheduler_post_event(task_handle h);
+uint32_t scheduler_run_events(void);
+
+// load levelling. Each task has a WCET in Timer 1 counts: declared, or else
+// the longest run the profiler has seen, rounded up. scheduler_level_load()
+// re-phases all the tasks so the worst tick is as light as it can make it
+// (greedy, longest WCET first), and returns that worst tick.
+// scheduler_peak_load() predicts the worst tick as things are. Both look at
+// one hyperperiod of the tasks (the LCM of their periods) if that is no more
+// than LEVEL_TICKS, which is exact as the load repeats after it. A longer
+// one is cut to the next LEVEL_TICKS, a fixed window and only a heuristic:
+// the demo table's hyperperiod is 234000 ticks. The window is on the
+// caller's stack while they run, 2 bytes a tick, so no RAM is kept for it.
+#define LEVEL_TICKS 400     // 2s, the longest window
+void scheduler_set_wcet(task_handle h, uint32_t counts);
+uint32_t scheduler_level_load(void);
+uint32_t scheduler_peak_load(void);
+
+// overruns. The hook runs from run_scheduler() (not the ISR) once per
+// overrun, with the task that was running when the tick came and the number
+// of ticks that came before the scheduler caught up so far.
+void scheduler_set_overrun_policy(uint32_t policy);
+uint32_t scheduler_overrun_policy(void);
+void scheduler_set_overrun_hook(void (*hook)(task_handle running, uint32_t late));
+uint32_t scheduler_overruns(void);
+// most core timer cycles from a tick to the end of its tasks (see timestamp.h)
+uint32_t scheduler_busy_max(uint32_t reset);
+// the same in Timer 1 counts (system_timer_max, shown by the run LED)
+uint32_t scheduler_tick_max(void);
+// releases of a task that ran late, were folded into one or were shed
+uint32_t scheduler_task_misses(uint32_t t);
+
+// execution time statistics, one entry per pool slot (0 if slot is free)
+uint32_t scheduler_num_tasks(void);
+uint32_t scheduler_task_active(uint32_t t);
+// ticks between releases, 0 for an event task
+uint32_t scheduler_task_period(uint32_t t);
+#ifdef PROFILE_TASKS
+const profile_stats * scheduler_task_profile(uint32_t t);
+#endif
+void scheduler_profile_reset(void);
+// all of the above, misses, overruns and the busy maxima back to 0
+void scheduler_stats_reset(void);
 
 #endif 
 
@@ -0,0 +1,98 @@
+/*
+ * File:   bench_log.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ * Host benchmark: cost at the call site of xprintf() into the debug print
+ * buffer against a deferred debug_log(), and what the drain costs later in
+ * dead time. Host ns are only a guide to the M4K, but the ratio holds: the
+ * deferred call is a handful of stores, xprintf() parses and converts.
+ *
+ *   make -C sim bench && sim/bench_log
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <time.h>
+
+#include "debug_uart.h"
+#include "debug_log.h"
+#include "xprintf.h"
+
+#define BENCH_CALLS 2000000UL
+// calls between buffer resets, so nothing is dropped
+#define BATCH 16
+
+// the rest of the system, stubbed out
+uint32_t scheduler_now(void){
+    return 0;
+}
+
+uint32_t hal_tick_timer_count(void){
+    return 0;
+}
+
+int32_t hal_uart_tx_ready(void){
+    return 1;
+}
+
+void hal_uart_tx(uint8_t c){
+    (void)c;
+}
+
+uint32_t hal_core_timer(void){
+    return 0;
+}
+
+static double now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(void){
+    static const char * const fmts[] = { "*T%d*", "=============%d\r\n",
+                                         "P%u n%u %u/%u\r\n" };
+    static const char * const names[] = { "*T%d*", "=============%d",
+                                          "P%u n%u %u/%u" };
+    uint32_t f, i, j;
+    double t0, t_print, t_log, t_drain;
+
+    printf("format                 xprintf ns  debug_log ns  drain ns\n");
+    for (f = 0; f < sizeof fmts / sizeof fmts[0]; f++){
+        t_print = 0;
+        t_log = 0;
+        t_drain = 0;
+        for (i = 0; i < BENCH_CALLS; i += BATCH){
+            init_debug_uart();
+            t0 = now_ns();
+            for (j = 0; j < BATCH; j++){
+                xprintf(fmts[f], i + j, 12345, 678, 9);
+            }
+            t_print += now_ns() - t0;
+
+            init_debug_uart();
+            init_debug_log();
+            t0 = now_ns();
+            for (j = 0; j < BATCH; j++){
+                debug_log(fmts[f], i + j, 12345, 678, 9);
+            }
+            t_log += now_ns() - t0;
+
+            t0 = now_ns();
+            for (j = 0; j < BATCH; j++){
+                init_debug_uart();
+                debug_log_drain();
+            }
+            t_drain += now_ns() - t0;
+        }
+        if (debug_log_dropped()){
+            printf("DROPPED\n");
+        }
+        printf("%-22s %10.1f  %12.1f  %8.1f\n", names[f],
+                t_print / BENCH_CALLS, t_log / BENCH_CALLS, t_drain / BENCH_CALLS);
+    }
+    return 0;
+}
@@ -0,0 +1,380 @@
+/*
+ * File:   bench_print.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ * Host stress test of the debug print ring in debug_uart.c, reserve then
+ * commit, with real threads standing in for the tasks, ISR and drain.
+ *
+ * 1 to MAX_PRODUCERS producer threads (tasks at any level), a timer signal
+ * as an ISR that can land in the middle of producer 0's message, and a
+ * drain thread as the main loop. Messages are of varying length, so they
+ * wrap the ring at every offset, and the UART checks each arrives whole,
+ * in order and once. Producers wait for room; the ISR drops, and its drops
+ * (and one message too long for the ring) must match the buffer's count.
+ * Built as bench_print_dma (DEBUG_UART_DMA), the drain is the DMA channel
+ * instead: a thread that reads each transfer out of the ring a byte at a
+ * time, then sets block complete and the interrupt flag, and a thread for
+ * the CPU that runs the DMA ISR on the flag, from that or a producer's
+ * kick, while the channel goes on. A drain that stops is an error. First,
+ * the race between the two on its own: a block that completes while a kick
+ * has the ISR in, just after it reads block complete, must not be lost.
+ *
+ * A full ring is retried after sched_yield(), so it works on one core too.
+ *
+ *   make -C sim bench && sim/bench_print && sim/bench_print_dma
+ *
+ * The exit code is 1 on any error.
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "debug_uart.h"
+
+#define MAX_PRODUCERS 4
+#define ISR_PERIOD_US 20    // the timer signal, an ISR print
+
+static uint32_t errors;
+static uint32_t producers;
+static volatile uint32_t isr_seq;
+static timer_t isr_timer;
+
+static double now_s(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void unblock_isr(void){
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGALRM);
+    pthread_sigmask(SIG_UNBLOCK, &set, 0);
+}
+
+static void isr_arm(uint32_t us){
+    struct itimerspec its = { { 0, us * 1000 }, { 0, us * 1000 } };
+    timer_settime(isr_timer, 0, &its, 0);
+}
+
+#define PRINT_MSGS  400000UL
+// must match debug_uart.c
+#define PRINT_BUF_SIZE 256
+#define PRINT_ISR   MAX_PRODUCERS   // the producer number of the timer signal
+#define LINE_MAX    32
+
+static volatile uint32_t print_run;     // producers still going
+static volatile uint32_t print_stalled; // the drain stopped: give up
+static uint32_t print_next[MAX_PRODUCERS + 1];
+static uint32_t print_isr_got;
+static char uart_line[LINE_MAX];
+static uint32_t uart_len;
+
+static uint32_t print_check(uint32_t p, uint32_t seq){
+    return ((seq * 2654435761UL) >> 16 ^ p) & 0xFFFF;
+}
+
+static uint32_t make_msg(char * m, uint32_t p, uint32_t seq){
+    // 14 to 21 chars: producer, seq, check, padding, end of line
+    return sprintf(m, "%c%08x%04x%.*s\n", 'a' + p, seq, print_check(p, seq),
+            (int)(seq % 8), "........");
+}
+
+static void check_line(void){
+    /* A whole line has come out of the UART */
+    char want[LINE_MAX];
+    uint32_t p = uart_line[0] - 'a', seq;
+    if (p > PRINT_ISR || sscanf(uart_line + 1, "%8x", &seq) != 1
+            || make_msg(want, p, seq) != uart_len || memcmp(want, uart_line, uart_len) != 0
+            || (p == PRINT_ISR ? seq < print_next[p] : seq != print_next[p])){
+        if (errors++ < 10){
+            printf("ERROR print: \"%.*s\" torn or out of order\n", (int)uart_len - 1, uart_line);
+        }
+        return;
+    }
+    print_next[p] = seq + 1;     // the ISR's can skip, where it dropped
+    if (p == PRINT_ISR){
+        print_isr_got++;
+    }
+}
+
+int32_t hal_uart_tx_ready(void){
+    return 1;
+}
+
+void hal_uart_tx(uint8_t c){
+    /* The drain's UART, which only the drain thread sends to */
+    if (uart_len < LINE_MAX){
+        uart_line[uart_len] = c;
+    }
+    uart_len++;
+    if (c == '\n'){
+        if (uart_len > LINE_MAX){
+            errors++;
+            printf("ERROR print: %u char line\n", uart_len);
+        } else {
+            check_line();
+        }
+        uart_len = 0;
+    }
+}
+
+static void * print_producer(void * arg){
+    uint32_t p = (uint32_t)(uintptr_t)arg;
+    uint32_t i, len, n = PRINT_MSGS / producers;
+    char m[LINE_MAX];
+    uint64_t waits = 0;
+    if (p == 0){
+        unblock_isr();
+    }
+    for (i = 0; i < n && !print_stalled; i++){
+        len = make_msg(m, p, i);
+        while (!debug_buf_try_write((const uint8_t *)m, len) && !print_stalled){
+            waits++;
+            sched_yield();
+        }
+    }
+    __sync_fetch_and_sub(&print_run, 1);
+    return (void *)(uintptr_t)waits;
+}
+
+static void print_isr(int sig){
+    /* Higher level than any producer: it can come between another's
+     * reserve and commit. It cannot wait, so it drops when full. */
+    char m[LINE_MAX];
+    uint32_t len = make_msg(m, PRINT_ISR, isr_seq++);
+    (void)sig;
+    debug_buf_write((const uint8_t *)m, len);
+}
+
+#ifdef DEBUG_UART_DMA
+
+// DMA channel 0 and its interrupt. The channel thread moves the bytes and
+// sets block complete and the flag; the drain thread is the CPU, which runs
+// the ISR while the flag is set, as the channel goes on beside it.
+void DebugUartDma(void);
+static const volatile uint8_t * dma_src;
+static volatile uint32_t dma_left, dma_bytes, dma_off;
+static volatile int32_t dma_complete, dma_irq;     // CHBCIF, DMA0IF
+static int32_t dma_race;    // complete the block just after the next read
+static int32_t dma_flight;  // a transfer started and not complete, by hand
+
+void hal_uart_dma_start(const uint8_t * src, uint32_t len){
+    dma_src = src;
+    dma_flight = 1;
+    __sync_synchronize();
+    dma_left = len;
+}
+
+int32_t hal_uart_dma_done(void){
+    int32_t done = dma_complete;
+    if (dma_race){
+        dma_race = 0;
+        dma_flight = 0;
+        dma_complete = 1;
+        dma_irq = 1;
+    }
+    return done;
+}
+
+void hal_uart_dma_done_ack(void){
+    dma_complete = 0;       // whatever it is, like DCH0INTCLR
+}
+
+void hal_uart_dma_ack(void){
+    dma_irq = 0;            // likewise IFS1CLR
+}
+
+void hal_uart_dma_kick(void){
+    dma_irq = 1;
+}
+
+int32_t hal_uart_dma_irq_pending(void){
+    return dma_irq;
+}
+
+static void * print_channel(void * arg){
+    /* A byte at a time out of the ring, the last of a transfer well after
+     * the first, then block complete and the flag */
+    (void)arg;
+    while (!dma_off){
+        if (dma_left){
+            hal_uart_tx(*dma_src++);
+            dma_bytes++;
+            if (--dma_left == 0){
+                dma_complete = 1;
+                dma_irq = 1;
+            } else if ((dma_left & 63) == 0){
+                sched_yield();
+            }
+        } else {
+            sched_yield();
+        }
+    }
+    return 0;
+}
+
+static void * print_drain(void * arg){
+    /* The CPU: the DMA ISR while its flag is set. If the ring holds
+     * committed bytes that go nowhere for a second, with nothing in flight
+     * and no flag, the drain has stopped for good. */
+    pthread_t channel;
+    uint32_t bytes = 0;
+    double since = now_s();
+    (void)arg;
+    dma_off = 0;
+    pthread_create(&channel, 0, print_channel, 0);
+    while (print_run || dma_left || dma_irq || debug_print_free() != PRINT_BUF_SIZE){
+        if (dma_irq){
+            DebugUartDma();
+        } else if (bytes != dma_bytes){
+            bytes = dma_bytes;
+            since = now_s();
+        } else if (now_s() - since > 1.0){
+            printf("ERROR print: the DMA drain stopped with %u chars in the ring\n",
+                    PRINT_BUF_SIZE - debug_print_free());
+            errors++;
+            print_stalled = 1;
+            break;
+        } else {
+            sched_yield();
+        }
+    }
+    dma_off = 1;
+    pthread_join(channel, 0);
+    return 0;
+}
+
+static void dma_move(void){
+    /* The channel, by hand: the rest of the transfer, not yet complete */
+    while (dma_left){
+        hal_uart_tx(*dma_src++);
+        dma_left--;
+    }
+}
+
+static void run_race(void){
+    /* The race on its own, which the threads rarely hit. A kick runs the
+     * ISR while a transfer is in flight, and the block completes just after
+     * the ISR reads block complete: the ISR must run again for it, and the
+     * second message go out. */
+    char m[LINE_MAX];
+    uint32_t i;
+    memset(print_next, 0, sizeof print_next);
+    uart_len = 0;
+    dma_irq = 0;
+    init_debug_uart();
+    debug_buf_write((const uint8_t *)m, make_msg(m, 0, 0));    // kicks
+    DebugUartDma();     // starts it
+    dma_move();
+    debug_buf_write((const uint8_t *)m, make_msg(m, 0, 1));    // in flight, no kick
+    hal_uart_dma_kick();    // a producer that saw it idle, just before
+    dma_race = 1;
+    for (i = 0; i < 8 && (dma_irq || dma_left); i++){
+        DebugUartDma();
+        dma_move();
+        if (dma_flight){
+            dma_flight = 0;
+            dma_complete = 1;
+            dma_irq = 1;
+        }
+    }
+    if (print_next[0] != 2 || debug_print_free() != PRINT_BUF_SIZE){
+        printf("ERROR print race: %u of 2 messages out, %u chars stuck\n",
+                print_next[0], PRINT_BUF_SIZE - debug_print_free());
+        errors++;
+    }
+    printf("print race          %u of 2 out\n", print_next[0]);
+}
+
+#else
+
+static void * print_drain(void * arg){
+    /* The main loop, in dead time */
+    (void)arg;
+    while (print_run || debug_print_pending()){
+        if (debug_print_pending()){
+            debug_print_char();
+        } else {
+            sched_yield();
+        }
+    }
+    return 0;
+}
+
+#endif // DEBUG_UART_DMA
+
+static void run_print(uint32_t n){
+    static const uint8_t too_long[256];
+    pthread_t p[MAX_PRODUCERS], drainer;
+    uint32_t i, waits = 0;
+    void * w;
+    double t0 = now_s(), t;
+    producers = n;
+    print_run = n;
+    isr_seq = 0;
+    print_isr_got = 0;
+    uart_len = 0;
+    memset(print_next, 0, sizeof print_next);
+    init_debug_uart();
+    debug_buf_write(too_long, sizeof too_long);     // dropped and counted
+    pthread_create(&drainer, 0, print_drain, 0);
+    isr_arm(ISR_PERIOD_US);
+    for (i = 0; i < n; i++){
+        pthread_create(&p[i], 0, print_producer, (void *)(uintptr_t)i);
+    }
+    for (i = 0; i < n; i++){
+        pthread_join(p[i], &w);
+        waits += (uint32_t)(uintptr_t)w;
+    }
+    isr_arm(0);
+    pthread_join(drainer, 0);
+    t = now_s() - t0;
+    for (i = 0; i < n; i++){
+        if (print_next[i] != PRINT_MSGS / n){
+            printf("ERROR print producer %u: %u of %lu arrived\n", i, print_next[i], PRINT_MSGS / n);
+            errors++;
+        }
+    }
+    // only the ISR drops, and the message too long for the ring
+    if (print_isr_got + debug_print_dropped() - 1 != isr_seq
+            || debug_print_overflow() < sizeof too_long){
+        printf("ERROR print isr: %u sent, %u arrived, %u dropped (%u chars)\n",
+                isr_seq, print_isr_got, debug_print_dropped() - 1, debug_print_overflow());
+        errors++;
+    }
+    if (debug_print_free() != PRINT_BUF_SIZE || uart_len != 0){
+        printf("ERROR print: %u chars left\n", uart_len);
+        errors++;
+    }
+    printf("print %u producer%s  %8.2f M msgs/s   %8u full  %6u isr (%u dropped)\n",
+            n, n > 1 ? "s" : " ", (PRINT_MSGS + print_isr_got) / t / 1e6, waits,
+            isr_seq, debug_print_dropped() - 1);
+}
+
+int main(void){
+    struct sigevent sev = { .sigev_notify = SIGEV_SIGNAL, .sigev_signo = SIGALRM };
+    sigset_t set;
+    uint32_t n;
+    sigemptyset(&set);
+    sigaddset(&set, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &set, 0); // and every thread made from here
+    signal(SIGALRM, print_isr);
+    timer_create(CLOCK_MONOTONIC, &sev, &isr_timer);
+#ifdef DEBUG_UART_DMA
+    run_race();
+#endif
+    for (n = 1; n <= MAX_PRODUCERS && !print_stalled; n++){
+        run_print(n);
+    }
+    printf("%u errors\n", errors);
+    return errors ? 1 : 0;
+}
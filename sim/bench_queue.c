@@ -0,0 +1,350 @@
+/*
+ * File:   bench_queue.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ * Host stress test and benchmark for the queues in queue.c, with real
+ * threads standing in for the ISR's and the task.
+ *
+ * spsc: one producer thread and one consumer, QUEUE_ITEMS elements, every
+ * other one by claim/publish and the rest by put, likewise peek/release and
+ * get on the other side. The consumer checks every element arrives once,
+ * whole and in order.
+ * mpsc: 1 to MAX_PRODUCERS producer threads into one consumer. Each element
+ * carries its producer and sequence number, and the consumer checks each
+ * producer's come in order with none lost, duplicated or torn. A timer
+ * signal is one more producer, which can land in the middle of any of the
+ * others' claims, as an ISR would.
+ * small: 1 and 2 byte elements, which the slots pad out to the flag's
+ * alignment, through put and get over a few laps of the queue. Each get
+ * must copy the element and not a byte more.
+ *
+ * A full or empty queue is retried after sched_yield(), so it works on one
+ * core too (and shows how often the other side had to wait). Producers also
+ * yield now and then with a claimed slot half written, so the consumer gets
+ * to run in that window even on one core.
+ *
+ *   make -C sim bench && sim/bench_queue
+ *
+ * The exit code is 1 on any error.
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "queue.h"
+
+#define QUEUE_ITEMS   2000000UL
+#define MAX_PRODUCERS 4
+#define ISR_PERIOD_US 20    // the timer signal producer, in the mpsc runs
+
+typedef struct {
+    uint32_t producer;
+    uint32_t seq;
+    uint32_t check;         // ~seq ^ producer, to catch a torn element
+} item;
+
+SPSC_QUEUE(spsc, item, 64);
+MPSC_QUEUE(mpsc, item, 64);
+SPSC_QUEUE(spsc8, uint8_t, 8);
+MPSC_QUEUE(mpsc8, uint8_t, 8);
+SPSC_QUEUE(spsc16, uint16_t, 8);
+MPSC_QUEUE(mpsc16, uint16_t, 8);
+
+static uint32_t errors;
+static uint32_t producers;
+
+static double now_s(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void check_item(const item * e, uint32_t producer, uint32_t seq){
+    if (e->producer != producer || e->seq != seq || e->check != (~seq ^ producer)){
+        if (errors++ < 10){
+            printf("ERROR producer %u seq %u: got producer %u seq %u check %08x\n",
+                    producer, seq, e->producer, e->seq, e->check);
+        }
+    }
+}
+
+// --- SPSC ---
+
+static void * spsc_producer(void * arg){
+    uint32_t i;
+    (void)arg;
+    for (i = 0; i < QUEUE_ITEMS; i++){
+        item e = { 0, i, ~i };
+        if (i & 1){
+            item * s;
+            while ((s = spsc_claim(&spsc)) == 0){
+                sched_yield();
+            }
+            s->producer = 0;
+            if ((i & 63) == 1){
+                sched_yield(); // preempted with the slot half written
+            }
+            s->seq = e.seq;
+            s->check = e.check;
+            spsc_publish(&spsc);
+        } else {
+            while (!spsc_put(&spsc, &e)){
+                sched_yield();
+            }
+        }
+    }
+    return 0;
+}
+
+static void spsc_consumer(uint32_t * waits){
+    uint32_t i;
+    for (i = 0; i < QUEUE_ITEMS; i++){
+        if (i & 1){
+            item * s;
+            while ((s = spsc_peek(&spsc)) == 0){
+                (*waits)++;
+                sched_yield();
+            }
+            check_item(s, 0, i);
+            spsc_release(&spsc);
+        } else {
+            item e;
+            while (!spsc_get(&spsc, &e)){
+                (*waits)++;
+                sched_yield();
+            }
+            check_item(&e, 0, i);
+        }
+    }
+}
+
+static void run_spsc(void){
+    pthread_t p;
+    uint32_t waits = 0;
+    double t0 = now_s(), t;
+    spsc.full = 0;
+    pthread_create(&p, 0, spsc_producer, 0);
+    spsc_consumer(&waits);
+    pthread_join(p, 0);
+    t = now_s() - t0;
+    if (spsc_count(&spsc) != 0){
+        printf("ERROR spsc: %u left in the queue\n", spsc_count(&spsc));
+        errors++;
+    }
+    printf("spsc  1 producer   %8.2f M items/s  %8u full  %8u empty\n",
+            QUEUE_ITEMS / t / 1e6, spsc_full(&spsc), waits);
+}
+
+// --- MPSC ---
+
+static volatile uint32_t finished;      // producer threads done
+static volatile uint32_t isr_seq, isr_dropped;
+static timer_t isr_timer;
+
+static void unblock_isr(void){
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGALRM);
+    pthread_sigmask(SIG_UNBLOCK, &set, 0);
+}
+
+static void * mpsc_producer(void * arg){
+    uint32_t p = (uint32_t)(uintptr_t)arg;
+    uint32_t i, n = QUEUE_ITEMS / producers;
+    if (p == 0){
+        unblock_isr();
+    }
+    for (i = 0; i < n; i++){
+        item e = { p, i, ~i ^ p };
+        if (i & 1){
+            item * s;
+            while ((s = mpsc_claim(&mpsc)) == 0){
+                sched_yield();
+            }
+            s->producer = p;
+            if ((i & 63) == 1){
+                sched_yield(); // preempted with the slot half written
+            }
+            s->seq = e.seq;
+            s->check = e.check;
+            mpsc_publish(&mpsc, s);
+        } else {
+            while (!mpsc_put(&mpsc, &e)){
+                sched_yield();
+            }
+        }
+    }
+    __sync_fetch_and_add(&finished, 1);
+    return 0;
+}
+
+static void isr_producer(int sig){
+    /* A timer signal: an ISR that can come in the middle of a claim. Only
+     * producer 0 takes it, so it never runs twice at once on a multi core
+     * host. It cannot wait, so if full it drops. */
+    uint32_t i = isr_seq;
+    item e = { MAX_PRODUCERS, i, ~i ^ MAX_PRODUCERS };
+    (void)sig;
+    if (mpsc_put(&mpsc, &e)){
+        isr_seq = i + 1;
+    } else {
+        isr_dropped++;
+    }
+}
+
+static void isr_arm(uint32_t us){
+    struct itimerspec its = { { 0, us * 1000 }, { 0, us * 1000 } };
+    timer_settime(isr_timer, 0, &its, 0);
+}
+
+static uint32_t mpsc_consumer(uint32_t * waits){
+    /* Until every producer is done, the ISR is stopped and the queue is
+     * empty. Returns the elements taken. */
+    uint32_t next[MAX_PRODUCERS + 1] = { 0 };
+    uint32_t i = 0, p;
+    for (;;){
+        item e, * s = mpsc_peek(&mpsc);
+        if (s == 0){
+            if (finished == producers){
+                isr_arm(0);
+                if (mpsc_count(&mpsc) == 0){
+                    break;
+                }
+            }
+            (*waits)++;
+            sched_yield();
+            continue;
+        }
+        e = *s;
+        if (i++ & 1){
+            mpsc_release(&mpsc);
+        } else {
+            // take it again by copy, the same element
+            item g;
+            mpsc_get(&mpsc, &g);
+            if (g.seq != e.seq || g.producer != e.producer){
+                errors++;
+            }
+        }
+        p = (e.producer == MAX_PRODUCERS || e.producer < producers) ? e.producer : 0;
+        check_item(&e, p, next[p]);
+        next[p] = e.seq + 1;
+    }
+    for (p = 0; p < producers; p++){
+        if (next[p] != QUEUE_ITEMS / producers){
+            printf("ERROR producer %u: %u of %lu arrived\n", p, next[p], QUEUE_ITEMS / producers);
+            errors++;
+        }
+    }
+    if (next[MAX_PRODUCERS] != isr_seq){
+        printf("ERROR isr: %u of %u arrived\n", next[MAX_PRODUCERS], isr_seq);
+        errors++;
+    }
+    return i;
+}
+
+static void run_mpsc(uint32_t n){
+    pthread_t p[MAX_PRODUCERS];
+    uint32_t i, items, waits = 0;
+    double t0 = now_s(), t;
+    producers = n;
+    finished = 0;
+    isr_seq = 0;
+    isr_dropped = 0;
+    mpsc.full = 0;
+    isr_arm(ISR_PERIOD_US);
+    for (i = 0; i < n; i++){
+        pthread_create(&p[i], 0, mpsc_producer, (void *)(uintptr_t)i);
+    }
+    items = mpsc_consumer(&waits);
+    for (i = 0; i < n; i++){
+        pthread_join(p[i], 0);
+    }
+    t = now_s() - t0;
+    printf("mpsc  %u producer%s  %8.2f M items/s  %8u full  %8u empty  %6u isr (%u dropped)\n",
+            n, n > 1 ? "s" : " ", items / t / 1e6, mpsc_full(&mpsc), waits,
+            isr_seq, isr_dropped);
+}
+
+// --- SMALL ELEMENTS ---
+
+#define GUARD 0xA5
+
+static void check_small(const char * name, uint32_t size, const uint8_t * got, uint32_t v){
+    /* got is the element, little endian, then guard bytes to the end */
+    uint32_t i;
+    for (i = 0; i < 8; i++){
+        uint8_t want = (i < size) ? (uint8_t)(v >> (8 * i)) : GUARD;
+        if (got[i] != want){
+            printf("ERROR %s element %u: byte %u is %02x, not %02x\n", name, v, i, got[i], want);
+            errors++;
+            return;
+        }
+    }
+}
+
+static void run_small(const char * name, spsc_queue * s, mpsc_queue * m, uint32_t size){
+    /* Fill each queue until it refuses one, then empty it, a few times
+     * round. Elements are the count, from a word, so a put of too many
+     * bytes would carry the next byte of it along. */
+    uint32_t lap, n, v = 0x0201, w = 0x0201;
+    for (lap = 0; lap < 4; lap++){
+        uint32_t from = v;
+        while (spsc_put(s, &v) && mpsc_put(m, &v)){
+            v += 0x0101;
+        }
+        if (spsc_count(s) != s->mask + 1 || mpsc_count(m) != m->mask + 1){
+            printf("ERROR %s: %u and %u in queues of %u\n", name,
+                    spsc_count(s), mpsc_count(m), m->mask + 1);
+            errors++;
+        }
+        for (n = 0; n < s->mask + 1; n++){
+            uint8_t got[8];
+            memset(got, GUARD, sizeof got);
+            if (!spsc_get(s, got)){
+                break;
+            }
+            check_small(name, size, got, w);
+            memset(got, GUARD, sizeof got);
+            if (!mpsc_get(m, got)){
+                break;
+            }
+            check_small(name, size, got, w);
+            w += 0x0101;
+        }
+        if (w != from + (s->mask + 1) * 0x0101){
+            printf("ERROR %s: %u elements came back\n", name, (w - from) / 0x0101);
+            errors++;
+        }
+        v = w;
+    }
+    printf("small %u byte%s     %8u full\n", size, size > 1 ? "s" : " ",
+            spsc_full(s) + mpsc_full(m));
+}
+
+int main(void){
+    struct sigevent sev = { .sigev_notify = SIGEV_SIGNAL, .sigev_signo = SIGALRM };
+    sigset_t set;
+    uint32_t n;
+    sigemptyset(&set);
+    sigaddset(&set, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &set, 0); // and every thread made from here
+    signal(SIGALRM, isr_producer);
+    timer_create(CLOCK_MONOTONIC, &sev, &isr_timer);
+    run_spsc();
+    run_small("small 1", &spsc8, &mpsc8, 1);
+    run_small("small 2", &spsc16, &mpsc16, 2);
+    for (n = 1; n <= MAX_PRODUCERS; n++){
+        run_mpsc(n);
+    }
+    printf("%u errors\n", errors);
+    return errors ? 1 : 0;
+}
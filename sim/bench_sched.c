@@ -0,0 +1,136 @@
+/*
+ * File:   bench_sched.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ * Host benchmark: per tick dispatch overhead against task count, for the
+ * original RIOS style scan (every task, every tick) and the timing wheel.
+ * The task bodies are empty, so what is measured is the dispatcher. As well
+ * as host time it reports how many task entries each one looks at per tick,
+ * which is what costs on the M4K (every touch is a load, most a store too).
+ *
+ *   make -C sim bench && sim/bench_sched
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <time.h>
+
+#include "timing_wheel.h"
+
+#define MAX_TASKS   WHEEL_MAX_ENTRIES
+#define BENCH_TICKS 2000000UL
+
+// a mix like the real task list: a few every tick, most at 10 to 1000 ticks
+static const uint32_t period_mix[] = { 1, 10, 20, 100, 200, 400, 234, 50, 1000, 20 };
+#define NUM_PERIODS (sizeof period_mix / sizeof period_mix[0])
+
+static volatile uint32_t work;
+
+static void tick_fct(void){
+    work++;
+}
+
+// --- the original scan ---
+
+typedef struct {
+    uint32_t period;
+    uint32_t elapsedTime;
+    void (*TickFct)(void);
+} scan_task;
+
+static scan_task scan_tasks[MAX_TASKS];
+
+static void scan_run(uint32_t n){
+    uint32_t t;
+    for (t = 0; t < n; ++t) {
+        if (scan_tasks[t].elapsedTime >= scan_tasks[t].period) {
+            scan_tasks[t].TickFct();
+            scan_tasks[t].elapsedTime = 0;
+        }
+        scan_tasks[t].elapsedTime++;
+    }
+}
+
+// --- the timing wheel, as run_scheduler() uses it ---
+
+typedef struct {
+    uint32_t period;
+    void (*TickFct)(void);
+} wheel_task;
+
+static wheel_task wheel_tasks[MAX_TASKS];
+
+static void wheel_run(uint32_t now){
+    wheel_mask due = wheel_take_due(now);
+    while (due) {
+        uint32_t t = wheel_first(due);
+        due &= due - 1;
+        wheel_tasks[t].TickFct();
+        wheel_insert(t, now + wheel_tasks[t].period);
+    }
+}
+
+static double now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(void){
+    static const uint32_t counts[] = { 4, 8, 12, 16, 24, 32 };
+    uint32_t c, t, tick;
+
+    printf("tasks  scan ns/tick  wheel ns/tick  calls/tick  "
+           "scan touch/tick  wheel touch/tick\n");
+    for (c = 0; c < sizeof counts / sizeof counts[0]; c++){
+        uint32_t n = counts[c];
+        uint32_t calls_scan, calls_wheel, touches;
+        double t0, t_scan, t_wheel;
+
+        for (t = 0; t < n; t++){
+            scan_tasks[t].period = period_mix[t % NUM_PERIODS];
+            scan_tasks[t].elapsedTime = 0;
+            scan_tasks[t].TickFct = tick_fct;
+        }
+        work = 0;
+        t0 = now_ns();
+        for (tick = 0; tick < BENCH_TICKS; tick++){
+            scan_run(n);
+        }
+        t_scan = now_ns() - t0;
+        calls_scan = work;
+
+        wheel_init();
+        for (t = 0; t < n; t++){
+            wheel_tasks[t].period = period_mix[t % NUM_PERIODS];
+            wheel_tasks[t].TickFct = tick_fct;
+            wheel_insert(t, wheel_tasks[t].period);
+        }
+        work = 0;
+        t0 = now_ns();
+        for (tick = 0; tick < BENCH_TICKS; tick++){
+            wheel_run(tick);
+        }
+        t_wheel = now_ns() - t0;
+        calls_wheel = work;
+
+        // untimed: ids in the slot looked at each tick, due or next lap
+        touches = 0;
+        for (; tick < 2 * BENCH_TICKS; tick++){
+            for (t = 0; t < n; t++){
+                touches += ((wheel_release(t) & WHEEL_MASK) == (tick & WHEEL_MASK));
+            }
+            wheel_run(tick);
+        }
+
+        printf("%5u  %12.1f  %13.1f  %10.2f  %15u  %16.2f%s\n", n,
+                t_scan / BENCH_TICKS, t_wheel / BENCH_TICKS,
+                (double)calls_wheel / BENCH_TICKS, n,
+                (double)touches / BENCH_TICKS,
+                (calls_scan == calls_wheel) ? "" : "  MISMATCH");
+    }
+    return 0;
+}
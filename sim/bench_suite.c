@@ -0,0 +1,379 @@
+/*
+ * File:   bench_suite.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ * Host benchmark suite for the hot paths, built from the same sources as
+ * the sim but with the hardware stubbed out (hal_stub.c), so only the code
+ * is timed (no signals, interrupt disable is free as it nearly is on the
+ * M4K).
+ *  - sched: run_scheduler() per tick against the number of tasks, all due
+ *    every tick ("every") and a mix of periods like the real list ("mix")
+ *  - buf: debug print buffer writes per second with 1 to 4 producer threads
+ *    standing in for ISR levels, and a drain thread emptying it. Producers
+ *    wait for room, so it is as fast as the drain lets them; the ones that
+ *    lose the race for it are dropped and counted. "put" is debug_buf_put()
+ *    (a char), "msg" a 24 char debug_buf_write()
+ *  - fmt: xprintf() into the buffer and xsprintf() to memory, per call
+ *  - log: debug_log() to the end of the line leaving the drain
+ * One result per line, so runs can be compared with a script:
+ *     bench,case,n,value,unit
+ * Given an earlier run with -c, each result that is more than -t percent
+ * (default 10) worse than it is reported on stderr, and the exit code is 1.
+ * Worst case latencies and drop counts are too noisy on a host, so they are
+ * not compared.
+ *
+ *   make -C sim bench && sim/bench_suite > bench.csv
+ *   sim/bench_suite -c bench.csv > new.csv
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "initialise.h"
+#include "scheduler.h"
+#include "debug_uart.h"
+#include "debug_log.h"
+#include "xprintf.h"
+
+#define SCHED_TICKS     1000000UL
+#define FMT_CALLS       1000000UL
+#define BUF_RUN_NS      200000000ULL
+#define LOG_LINES       100000UL
+// timed runs of sched and fmt, the fastest is taken (the host is not quiet)
+#define REPEATS 3
+// calls between buffer resets, so nothing is dropped
+#define BATCH 8
+
+// in debug_uart.c, xprintf() reaches it through xdev_out()
+void debug_buf_put(uint8_t c);
+
+// --- the hardware, stubbed out in hal_stub.c, its clock stopped ---
+
+// the UART: always ready, counts what it is sent and notes line ends
+static volatile uint64_t uart_chars;
+static volatile uint64_t uart_lines;
+
+int32_t hal_uart_tx_ready(void){
+    return 1;
+}
+
+void hal_uart_tx(uint8_t c){
+    uart_chars++;
+    if (c == '\n'){
+        uart_lines++;
+    }
+}
+
+static uint64_t now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// --- results, and the run to compare them with ---
+
+#define MAX_RESULTS 64
+
+typedef struct {
+    char key[112];      // bench,case,n,unit
+    double value;
+} baseline;
+
+static baseline base[MAX_RESULTS];
+static uint32_t num_base;
+static double tolerance = 10.0;
+static uint32_t regressions;
+
+static void make_key(char * key, const char * bench, const char * name,
+                     uint32_t n, const char * unit){
+    snprintf(key, sizeof base[0].key, "%s,%s,%u,%s", bench, name, n, unit);
+}
+
+static void read_baseline(const char * file){
+    char line[128], bench[32], name[32], unit[32];
+    uint32_t n;
+    double value;
+    FILE * fp = fopen(file, "r");
+    if (!fp){
+        perror(file);
+        exit(2);
+    }
+    while (fgets(line, sizeof line, fp) && num_base < MAX_RESULTS){
+        if (sscanf(line, "%31[^,],%31[^,],%u,%lf,%31s", bench, name, &n, &value, unit) == 5){
+            make_key(base[num_base].key, bench, name, n, unit);
+            base[num_base].value = value;
+            num_base++;
+        }
+    }
+    fclose(fp);
+}
+
+static void result(const char * bench, const char * name, uint32_t n,
+                   double value, const char * unit){
+    char key[sizeof base[0].key];
+    double change;
+    uint32_t i;
+
+    printf("%s,%s,%u,%.1f,%s\n", bench, name, n, value, unit);
+    fflush(stdout);
+    if (strcmp(name, "max") == 0 || strcmp(unit, "dropped") == 0){
+        return;
+    }
+    make_key(key, bench, name, n, unit);
+    for (i = 0; i < num_base; i++){
+        if (strcmp(key, base[i].key) == 0 && base[i].value > 0){
+            // rates are better higher, times lower
+            change = (value - base[i].value) * 100.0 / base[i].value;
+            if (strstr(unit, "/s")){
+                change = -change;
+            }
+            if (change > tolerance){
+                fprintf(stderr, "REGRESSION %s: %.1f -> %.1f (%+.0f%%)\n",
+                        key, base[i].value, value, change);
+                regressions++;
+            }
+        }
+    }
+}
+
+// --- sched ---
+
+static volatile uint32_t work;
+
+static void tick_fct(void){
+    work++;
+}
+
+static const uint32_t period_mix[] = { 1, 10, 20, 100, 200, 400, 234, 50, 1000, 20 };
+#define NUM_PERIODS (sizeof period_mix / sizeof period_mix[0])
+
+static void bench_sched(void){
+    task_handle h[SCHEDULER_MAX_TASKS];
+    uint32_t first, max, n, t, mix, i, r;
+    uint64_t t0, best;
+
+    /* The table tasks have the handles below the first free one. Take them
+     * out, so only the bench tasks run. */
+    init_scheduler();
+    first = scheduler_add_task(tick_fct, 1, 0);
+    for (t = 0; t < first; t++){
+        scheduler_remove_task(t);
+    }
+    scheduler_remove_task(first);
+    run_scheduler();
+    max = SCHEDULER_MAX_TASKS - first;
+
+    for (mix = 0; mix < 2; mix++){
+        for (n = 1; n <= max; n = (n * 2 > max && n != max) ? max : n * 2){
+            for (t = 0; t < n; t++){
+                h[t] = scheduler_add_task(tick_fct, mix ? period_mix[t % NUM_PERIODS] : 1, 0);
+            }
+            run_scheduler();
+            best = ~0ULL;
+            for (r = 0; r < REPEATS; r++){
+                t0 = now_ns();
+                for (i = 0; i < SCHED_TICKS; i++){
+                    run_scheduler();
+                }
+                t0 = now_ns() - t0;
+                best = (t0 < best) ? t0 : best;
+            }
+            result("sched", mix ? "mix" : "every", n,
+                    (double)best / SCHED_TICKS, "ns/tick");
+            for (t = 0; t < n; t++){
+                scheduler_remove_task(h[t]);
+            }
+            run_scheduler();
+        }
+    }
+}
+
+// --- buf ---
+
+static volatile int32_t buf_run;
+static volatile int32_t drain_run;
+static const uint8_t buf_msg[] = "P3 n4 1/1/2 h 0 2 2\r\n...";
+
+static void * producer_put(void * arg){
+    uint64_t n = 0;
+    while (buf_run){
+        if (debug_print_free() < 1){
+            sched_yield();  // let the drain run, if there is one core
+        } else {
+            debug_buf_put('x');
+            n++;
+        }
+    }
+    *(uint64_t *)arg = n;
+    return 0;
+}
+
+static void * producer_msg(void * arg){
+    uint64_t n = 0;
+    while (buf_run){
+        if (debug_print_free() < 24){
+            sched_yield();  // let the drain run, if there is one core
+        } else {
+            debug_buf_write(buf_msg, 24);
+            n++;
+        }
+    }
+    *(uint64_t *)arg = n;
+    return 0;
+}
+
+static void * drain(void * arg){
+    (void)arg;
+    while (drain_run || debug_print_pending()){
+        if (debug_print_pending()){
+            debug_print_char();
+        } else {
+            sched_yield();
+        }
+    }
+    return 0;
+}
+
+static void bench_buf(void){
+    static const char * const names[] = { "put", "msg" };
+    static const uint32_t len[] = { 1, 24 };
+    pthread_t prod[4], drainer;
+    uint64_t tries[4], total, sent;
+    uint32_t m, n, p;
+    uint64_t t0, dt;
+
+    for (m = 0; m < 2; m++){
+        for (n = 1; n <= 4; n++){
+            init_debug_uart();
+            uart_chars = 0;
+            buf_run = 1;
+            drain_run = 1;
+            pthread_create(&drainer, 0, drain, 0);
+            t0 = now_ns();
+            for (p = 0; p < n; p++){
+                pthread_create(&prod[p], 0, m ? producer_msg : producer_put, &tries[p]);
+            }
+            while (now_ns() - t0 < BUF_RUN_NS){
+                sched_yield();
+            }
+            buf_run = 0;
+            total = 0;
+            for (p = 0; p < n; p++){
+                pthread_join(prod[p], 0);
+                total += tries[p];
+            }
+            dt = now_ns() - t0;
+            drain_run = 0;
+            pthread_join(drainer, 0);
+            sent = total - debug_print_dropped();
+            result("buf", names[m], n, sent * 1e6 / dt, "kwrites/s");
+            result("buf", names[m], n, (double)debug_print_dropped(), "dropped");
+            if (uart_chars != sent * len[m]){
+                result("buf", names[m], n, (double)uart_chars - sent * len[m], "LOST_CHARS");
+            }
+        }
+    }
+}
+
+// --- fmt ---
+
+static const char * const fmt_strs[] = { "=============%d\r\n", "*T%d*",
+                                         "P%u n%u %u/%u/%u h %u %u\r\n",
+                                         "I %u wake/s %u%% idle\r\n" };
+static const char * const fmt_names[] = { "ruler", "timer2", "profile", "idle" };
+
+static void bench_fmt(void){
+    char line[128];
+    uint32_t f, i, j, r;
+    uint64_t t0, t, t_print, t_sprint;
+
+    for (f = 0; f < sizeof fmt_strs / sizeof fmt_strs[0]; f++){
+        t_print = ~0ULL;
+        t_sprint = ~0ULL;
+        for (r = 0; r < REPEATS; r++){
+            t = 0;
+            for (i = 0; i < FMT_CALLS; i += BATCH){
+                init_debug_uart();
+                t0 = now_ns();
+                for (j = 0; j < BATCH; j++){
+                    xprintf(fmt_strs[f], j, 12345, 678, 9, 10, 11, 12);
+                }
+                t += now_ns() - t0;
+            }
+            t_print = (t < t_print) ? t : t_print;
+            t0 = now_ns();
+            for (i = 0; i < FMT_CALLS; i++){
+                xsprintf(line, fmt_strs[f], i, 12345, 678, 9, 10, 11, 12);
+            }
+            t = now_ns() - t0;
+            t_sprint = (t < t_sprint) ? t : t_sprint;
+        }
+        result("fmt", fmt_names[f], 0, (double)t_print / FMT_CALLS, "ns/xprintf");
+        result("fmt", fmt_names[f], 0, (double)t_sprint / FMT_CALLS, "ns/xsprintf");
+    }
+}
+
+// --- log ---
+
+static int cmp_u64(const void * a, const void * b){
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_log(void){
+    static uint64_t lat[LOG_LINES];
+    uint64_t t0, sum = 0, lines;
+    uint32_t i;
+
+    init_debug_uart();
+    init_debug_log();
+    for (i = 0; i < LOG_LINES; i++){
+        lines = uart_lines;
+        t0 = now_ns();
+        debug_log("*T%d* P%u n%u\r\n", i, 12345, 678);
+        while (uart_lines == lines){   // as the main loop runs them
+            debug_log_drain();
+            debug_print_char();
+        }
+        lat[i] = now_ns() - t0;
+        sum += lat[i];
+    }
+    qsort(lat, LOG_LINES, sizeof lat[0], cmp_u64);
+    result("log", "mean", 0, (double)sum / LOG_LINES, "ns");
+    result("log", "p50", 0, lat[LOG_LINES / 2], "ns");
+    result("log", "p99", 0, lat[LOG_LINES * 99 / 100], "ns");
+    result("log", "max", 0, lat[LOG_LINES - 1], "ns");
+}
+
+int main(int argc, char ** argv){
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:t:")) != -1){
+        switch (opt){
+        case 'c':
+            read_baseline(optarg);
+            break;
+        case 't':
+            tolerance = atof(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-c baseline.csv] [-t percent]\n", argv[0]);
+            return 2;
+        }
+    }
+    printf("bench,case,n,value,unit\n");
+    bench_sched();
+    bench_buf();
+    bench_fmt();
+    bench_log();
+    return regressions ? 1 : 0;
+}
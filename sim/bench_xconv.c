@@ -0,0 +1,213 @@
+/*
+ * File:   bench_xconv.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ * Host check and benchmark for the xprintf number conversion. First every
+ * number format (d u x X o b, with and without l, flags none/0/-, a range of
+ * widths) is compared with the divide loop xprintf used to have, over a
+ * spread of values: all up to 65535, powers of 2 and 10 either side, and
+ * random ones. Then the cost of one conversion is timed, like for like:
+ * xnumeral(), which xvprintf() calls for every number up to 32 bits,
+ * against the old divide loop, each putting the digits of the magnitude in
+ * a buffer (no sign, padding or output). Cycles are the x86 TSC where there
+ * is one, else ns.
+ *
+ *   make -C sim bench && sim/bench_xconv        check and time
+ *   sim/bench_xconv -x                          check every 32 bit value
+ *                                               as well (about an hour)
+ * The exit code is 1 on any mismatch.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "xprintf.h"
+
+#define BENCH_CALLS 2000000UL
+
+static inline uint64_t cycles(void){
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/* The number conversion as it was in xvprintf(): f is the flags (1 '0',
+ * 2 '-'), w the width, c the type character. */
+static void ref_conv(char * o, uint32_t f, uint32_t w, char c, long v){
+    uint32_t r, i, j;
+    unsigned long vs;
+    char s[24], d;
+
+    d = (c >= 'a') ? c - 0x20 : c;
+    r = (d == 'B') ? 2 : (d == 'O') ? 8 : (d == 'X') ? 16 : 10;
+    if (d == 'D' && v < 0){
+        v = 0 - v; f |= 16;
+    }
+    i = 0; vs = v;
+    do {
+        d = (char)(vs % r); vs /= r;
+        if (d > 9) d += (c == 'x') ? 0x27 : 0x07;
+        s[i++] = d + '0';
+    } while (vs != 0 && i < sizeof s);
+    if (f & 16) s[i++] = '-';
+    j = i; d = (f & 1) ? '0' : ' ';
+    while (!(f & 2) && j++ < w) *o++ = d;
+    do *o++ = s[--i]; while (i != 0);
+    while (j++ < w) *o++ = ' ';
+    *o = 0;
+}
+
+/* Just the digits, as the divide loop in ref_conv() makes them. Not
+ * inlined, as xnumeral() is not, from its own file. */
+static __attribute__((noinline)) uint32_t ref_digits(char * s, uint32_t x, uint32_t r, char c){
+    uint32_t i = 0;
+    char d;
+    do {
+        d = (char)(x % r); x /= r;
+        if (d > 9) d += (c == 'x') ? 0x27 : 0x07;
+        s[i++] = d + '0';
+    } while (x != 0 && i < 24);
+    return i;
+}
+
+static const char types[] = "duxXob";
+static const char * const flags[] = { "", "0", "-" };
+static const uint32_t widths[] = { 0, 1, 5, 10, 24 };
+#define NUM_FLAGS  (sizeof flags / sizeof flags[0])
+#define NUM_WIDTHS (sizeof widths / sizeof widths[0])
+
+static uint32_t checked, mismatches;
+
+// one value, formatted as xvprintf() takes the argument for this spec
+static void check_one(const char * fmt, uint32_t f, uint32_t w, char c,
+                      uint32_t l, uint32_t x){
+    char got[64], want[64];
+    long v;
+
+    if (l){
+        v = (c == 'd') ? (long)(int32_t)x : (long)x;
+        xsprintf(got, fmt, v);
+    } else if (c == 'd'){
+        v = (int32_t)x;
+        xsprintf(got, fmt, (int32_t)x);
+    } else {
+        v = x;
+        xsprintf(got, fmt, x);
+    }
+    ref_conv(want, f, w, c, v);
+    checked++;
+    if (strcmp(got, want) != 0){
+        if (mismatches++ < 10){
+            printf("MISMATCH %s 0x%08x: \"%s\" not \"%s\"\n", fmt, x, got, want);
+        }
+    }
+}
+
+static uint32_t rand_state = 1;
+static uint32_t next_rand(void){
+    rand_state = rand_state * 1664525UL + 1013904223UL;
+    return rand_state;
+}
+
+// every spec against the spread of values
+static void check_specs(void){
+    uint32_t t, f, w, l, k, x, p;
+    char fmt[16];
+
+    for (t = 0; types[t]; t++) for (f = 0; f < NUM_FLAGS; f++)
+    for (w = 0; w < NUM_WIDTHS; w++) for (l = 0; l < 2; l++){
+        char c = types[t];
+        if (widths[w]){
+            sprintf(fmt, "%%%s%u%s%c", flags[f], widths[w], l ? "l" : "", c);
+        } else {
+            sprintf(fmt, "%%%s%s%c", flags[f], l ? "l" : "", c);
+        }
+        for (x = 0; x <= 0xFFFF; x++){
+            check_one(fmt, f, widths[w], c, l, x);
+        }
+        for (k = 0; k < 32; k++){
+            for (x = (1UL << k) - 2; x != (1UL << k) + 2; x++){
+                check_one(fmt, f, widths[w], c, l, x);
+                check_one(fmt, f, widths[w], c, l, 0 - x);
+            }
+        }
+        for (p = 1, k = 0; k < 10; k++, p *= 10){
+            check_one(fmt, f, widths[w], c, l, p - 1);
+            check_one(fmt, f, widths[w], c, l, p);
+            check_one(fmt, f, widths[w], c, l, 0 - p);
+        }
+        for (k = 0; k < 4096; k++){
+            check_one(fmt, f, widths[w], c, l, next_rand());
+        }
+    }
+}
+
+// every 32 bit value, bare specs
+static void check_all(void){
+    char fmt[4] = "%?";
+    uint32_t t, x;
+
+    for (t = 0; types[t]; t++){
+        fmt[1] = types[t];
+        x = 0;
+        do {
+            check_one(fmt, 0, 0, types[t], 0, x);
+        } while (++x != 0);
+        printf("  %s all 2^32 done, %u mismatches\n", fmt, mismatches);
+        fflush(stdout);
+    }
+}
+
+static char sink[64];
+
+int main(int argc, char ** argv){
+    static const char * const fmts[] = { "%u", "%d", "%8d", "%x", "%08X", "%b" };
+    static const uint32_t vals[] = { 7, 1234, 65535, 3750000, 4000000000UL };
+    uint32_t n, k, i;
+    uint64_t t0, t_new, t_old;
+
+    check_specs();
+    if (argc > 1 && strcmp(argv[1], "-x") == 0){
+        check_all();
+    }
+    printf("checked %u conversions, %u mismatches\n", checked, mismatches);
+
+    printf("\nformat  value        xnumeral  old divide loop  (%s/number)\n",
+#if defined(__x86_64__) || defined(__i386__)
+           "cycles"
+#else
+           "ns"
+#endif
+           );
+    for (n = 0; n < sizeof fmts / sizeof fmts[0]; n++){
+        char c = fmts[n][strlen(fmts[n]) - 1];
+        char d = (c >= 'a') ? c - 0x20 : c;
+        uint32_t r = (d == 'B') ? 2 : (d == 'O') ? 8 : (d == 'X') ? 16 : 10;
+        for (k = 0; k < sizeof vals / sizeof vals[0]; k++){
+            // the magnitude, as xvprintf() has it by then
+            uint32_t x = (c == 'd' && (int32_t)vals[k] < 0) ? 0 - vals[k] : vals[k];
+            t0 = cycles();
+            for (i = 0; i < BENCH_CALLS; i++){
+                xnumeral((int8_t *)sink, 24, x, r, c);
+            }
+            t_new = cycles() - t0;
+            t0 = cycles();
+            for (i = 0; i < BENCH_CALLS; i++){
+                ref_digits(sink, x, r, c);
+            }
+            t_old = cycles() - t0;
+            printf("%-6s  %10u  %9.1f  %15.1f\n", fmts[n], vals[k],
+                    (double)t_new / BENCH_CALLS, (double)t_old / BENCH_CALLS);
+        }
+    }
+    return mismatches ? 1 : 0;
+}
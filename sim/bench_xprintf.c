@@ -0,0 +1,123 @@
+/*
+ * File:   bench_xprintf.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ * Host benchmark: cost per printed character of xprintf() into the debug
+ * print buffer, one xfunc_out call per character (no xfunc_out_block, how
+ * xprintf worked first) against the whole message staged and put in one
+ * debug_buf_write(). Each is run from the main loop ("task") and from a
+ * signal handler ("isr"), the way the sim runs interrupts.
+ * Cycles are the x86 TSC where there is one, else ns.
+ *
+ *   make -C sim bench && sim/bench_xprintf
+ */
+
+#define _GNU_SOURCE
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "debug_uart.h"
+#include "xprintf.h"
+
+#define BENCH_CALLS 1000000UL
+// calls between buffer resets, so nothing is dropped
+#define BATCH 8
+
+// the rest of the system, stubbed out
+int32_t hal_uart_tx_ready(void){
+    return 1;
+}
+
+void hal_uart_tx(uint8_t c){
+    (void)c;
+}
+
+uint32_t hal_core_timer(void){
+    return 0;
+}
+
+static inline uint64_t cycles(void){
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+// the messages the tasks print
+static const char * const fmts[] = { "=============%d\n", "*T%d*",
+                                     "P%u n%u %u/%u/%u h %u %u\n",
+                                     "I %u wake/s %u%% idle\n" };
+static const char * const names[] = { "=============%d\\n", "*T%d*",
+                                      "P%u n%u %u/%u/%u h %u %u\\n",
+                                      "I %u wake/s %u%% idle\\n" };
+
+static const char * run_fmt;
+static int run_block;
+static volatile uint64_t run_cycles;   // set in the signal handler too
+
+// one timed run, in whatever context it is called from
+static void run(void){
+    uint32_t i, j;
+    uint64_t t0;
+
+    run_cycles = 0;
+    for (i = 0; i < BENCH_CALLS; i += BATCH){
+        init_debug_uart();
+        if (!run_block){
+            xdev_out_block(0);
+        }
+        t0 = cycles();
+        for (j = 0; j < BATCH; j++){
+            xprintf(run_fmt, j, 12345, 678, 9, 10, 11, 12);
+        }
+        run_cycles += cycles() - t0;
+    }
+}
+
+static void isr(int sig){
+    (void)sig;
+    run();
+}
+
+int main(void){
+    char line[128];
+    uint32_t f, b, chars;
+    double per_char[2][2];
+
+    signal(SIGUSR2, isr);
+    printf("format                       chars  char task  char isr  "
+           "block task  block isr  (%s/char)\n",
+#if defined(__x86_64__) || defined(__i386__)
+           "cycles"
+#else
+           "ns"
+#endif
+           );
+    for (f = 0; f < sizeof fmts / sizeof fmts[0]; f++){
+        xsprintf(line, fmts[f], 0, 12345, 678, 9, 10, 11, 12);
+        chars = strlen(line);
+        run_fmt = fmts[f];
+        for (b = 0; b < 2; b++){
+            run_block = b;
+            run();
+            per_char[b][0] = (double)run_cycles / BENCH_CALLS / chars;
+            raise(SIGUSR2);
+            per_char[b][1] = (double)run_cycles / BENCH_CALLS / chars;
+        }
+        if (debug_print_dropped()){
+            printf("DROPPED\n");
+        }
+        printf("%-28s %5u  %9.1f  %8.1f  %10.1f  %9.1f\n", names[f], chars,
+                per_char[0][0], per_char[0][1], per_char[1][0], per_char[1][1]);
+    }
+    printf("char: xfunc_out per character, block: xfunc_out_block per message\n");
+    return 0;
+}
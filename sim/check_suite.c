@@ -0,0 +1,324 @@
+/*
+ * File:   check_suite.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ * Host checks of the scheduler, built from the same sources as the sim but
+ * on the scripted clock of hal_stub.c rather than the real one: the core
+ * timer and Timer 1 only move when a check moves them, and the ISR's run
+ * when their timer comes due. So the checks are exact, tick for tick, however busy the host.
+ *  - tickless: a task retimed and one added from dead time, part way into
+ *    a stretched Timer 1 period, run on the ticks the real time says
+ *  - fast: fast ticks nested in a fast task, as Timer 3 interrupts it. The
+ *    higher priority task preempts it, it never preempts itself or a higher
+ *    one, an overrun counts once per release, and the profile is in core
+ *    timer cycles, preemption and all
+ *  - swtimer: software timers fire in deadline order, never early, ones
+ *    due together in the order they were started, and a periodic one held
+ *    off for whole periods skips and counts them without drifting
+ *
+ *   make -C sim check
+ *
+ * Prints each error, then the number of errors; exits 1 if there are any.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "initialise.h"
+#include "scheduler.h"
+#include "fast_tier.h"
+#include "swtimer.h"
+#include "debug_uart.h"
+#include "debug_log.h"
+#include "trace.h"
+#include "background.h"
+#include "timestamp.h"
+#include "hal_stub.h"
+
+// core timer cycles in a microsecond
+#define US_CYCLES   (CORE_TIMER_HZ / 1000000UL)
+
+// the fast tier ISR in fast_tier.c, run by hand
+void FastTick(void);
+
+static uint32_t errors;
+
+#define CHECK(cond, ...) do { if (!(cond)){ \
+        printf("ERROR " __VA_ARGS__); printf("\n"); errors++; } } while (0)
+
+// --- the hardware, on a scripted clock in hal_stub.c ---
+
+// the UART drops what it is sent
+int32_t hal_uart_tx_ready(void){ return 1; }
+void hal_uart_tx(uint8_t c){ (void)c; }
+
+static void main_loop(uint64_t cycles){
+    /* main.c's loop for a time: the tick, then the dead time up to the
+     * next Timer 1 interrupt, which the CPU sleeps through */
+    uint64_t end = stub_core + cycles;
+    while (stub_core < end){
+        if (timer_tick()){
+            run_scheduler();
+            continue;
+        }
+        scheduler_run_events();
+        debug_log_drain();
+        trace_drain();
+        while (debug_print_pending()){
+            debug_print_char();
+        }
+        background_run();
+        scheduler_idle();
+        if (!timer_tick()){
+            uint64_t next = stub_t1_start + (uint64_t)(stub_pr1 + 1) * T1_CYCLES;
+            stub_elapse(((next < end) ? next : end) - stub_core);
+        }
+    }
+}
+
+// --- tickless ---
+
+#define RUNS 8
+
+typedef struct {
+    uint32_t n;
+    uint32_t tick[RUNS];        // scheduler_now() in the task
+    uint64_t at[RUNS];          // and the tick by the clock
+} runs;
+
+static runs a_runs, b_runs;
+
+static void log_run(runs * r){
+    if (r->n < RUNS){
+        r->tick[r->n] = scheduler_now();
+        // tick 0 starts with the first interrupt, one tick in
+        r->at[r->n] = stub_t1_start / TICK_CYCLES - 1;
+    }
+    r->n++;
+}
+
+static void task_a(void){ log_run(&a_runs); }
+static void task_b(void){ log_run(&b_runs); }
+
+static void check_tickless(void){
+    /* Task a every 20 ticks, so the dead time after it is stretched over
+     * TICKLESS_MAX_SKIP ticks. 3.5 ticks into that, a goes to every 3 ticks
+     * and b is added, every 5: both must run on time, by the clock. */
+    task_handle a, t, first;
+    uint32_t now, i;
+
+    init_scheduler();
+    first = scheduler_add_task(task_a, 1, 0);
+    for (t = 0; t < first; t++){
+        scheduler_remove_task(t);
+    }
+    scheduler_remove_task(first);
+    a = scheduler_add_task(task_a, 20, 0);
+    main_loop(100 * TICK_CYCLES);
+    CHECK(a_runs.n >= 4, "tickless: a ran %u times in 100 ticks", a_runs.n);
+    for (i = 1; i < a_runs.n && i < RUNS; i++){
+        CHECK(a_runs.tick[i] - a_runs.tick[i - 1] == 20 && a_runs.at[i] == a_runs.tick[i],
+                "tickless: a at tick %u (clock %u), last %u",
+                a_runs.tick[i], (uint32_t)a_runs.at[i], a_runs.tick[i - 1]);
+    }
+
+    // run to the end of the next run of a, then into the stretched period
+    a_runs.n = 0;
+    while (a_runs.n == 0){
+        main_loop(T1_CYCLES);
+    }
+    CHECK(stub_pr1 > SYSTEM_TICK_TIMER, "tickless: Timer 1 not stretched after a");
+    stub_elapse(TICK_CYCLES * 7 / 2 - (stub_core - stub_t1_start));
+    now = scheduler_now();
+    CHECK(now == a_runs.tick[0] + 4, "tickless: scheduler_now() %u 3.5 ticks after %u",
+            now, a_runs.tick[0]);
+    scheduler_set_period(a, 3);
+    scheduler_add_task(task_b, 5, 0);
+    a_runs.n = 0;
+    main_loop(20 * TICK_CYCLES);
+    CHECK(a_runs.n >= 3 && b_runs.n >= 2, "tickless: a ran %u and b %u times in 20 ticks",
+            a_runs.n, b_runs.n);
+    for (i = 0; i < a_runs.n && i < RUNS; i++){
+        CHECK(a_runs.tick[i] == now + 3 * (i + 1) && a_runs.at[i] == a_runs.tick[i],
+                "tickless: a run %u at tick %u (clock %u), wanted %u",
+                i, a_runs.tick[i], (uint32_t)a_runs.at[i], now + 3 * (i + 1));
+    }
+    for (i = 0; i < b_runs.n && i < RUNS; i++){
+        CHECK(b_runs.tick[i] == now + 5 * (i + 1) && b_runs.at[i] == b_runs.tick[i],
+                "tickless: b run %u at tick %u (clock %u), wanted %u",
+                i, b_runs.tick[i], (uint32_t)b_runs.at[i], now + 5 * (i + 1));
+    }
+}
+
+// --- fast tier ---
+
+#define HI_CYCLES 1000
+#define LO_CYCLES 100
+
+static char fast_log[16];
+static uint32_t fast_log_n, hi_runs, lo_runs;
+
+static void fast_note(char c){
+    if (fast_log_n < sizeof fast_log - 1){
+        fast_log[fast_log_n++] = c;
+    }
+}
+
+static void fast_hi(void){
+    /* The second run takes 2 fast ticks, and the low priority task comes
+     * due in them: it must wait for this to finish. */
+    fast_note('H');
+    stub_core += HI_CYCLES;
+    if (hi_runs++ == 1){
+        FastTick();
+        FastTick();
+    }
+    fast_note('h');
+}
+
+static void fast_lo(void){
+    /* The first run takes 4 fast ticks: hi comes due in them and preempts
+     * it, and this comes due again, an overrun, for 2 of them. */
+    uint32_t i;
+    fast_note('L');
+    stub_core += LO_CYCLES;
+    if (lo_runs++ == 0){
+        for (i = 0; i < 4; i++){
+            FastTick();
+        }
+    }
+    fast_note('l');
+}
+
+static void check_fast(void){
+    /* hi every 4 fast ticks, lo every 2, each first released a period from
+     * now, at tick 5 and 3. lo runs at 3 and takes ticks 4 to 7: hi runs
+     * in it at 5, and lo is due again at 6 and 7, one overrun. lo runs
+     * late at 8. hi runs at 9 and takes ticks 10 and 11, lo is due at 11
+     * and runs after hi, still in tick 9. */
+    uint32_t hi, lo, i;
+#ifdef PROFILE_TASKS
+    const profile_stats * p;
+#endif
+
+    init_fast_tier();
+    scheduler_set_overrun_policy(OVERRUN_COUNT);
+    hi = fast_add_task(fast_hi, 4, 0);
+    lo = fast_add_task(fast_lo, 2, 0);
+    for (i = 0; i < 3; i++){
+        FastTick();
+    }
+    CHECK(fast_now() == 7, "fast: %u fast ticks, wanted 7", fast_now());
+    CHECK(fast_task_misses(hi) == 0 && fast_task_misses(lo) == 1 && fast_overruns() == 1,
+            "fast: misses hi %u lo %u, overruns %u, wanted 0 1 1",
+            fast_task_misses(hi), fast_task_misses(lo), fast_overruns());
+    FastTick();
+    FastTick();
+    CHECK(fast_now() == 11, "fast: %u fast ticks, wanted 11", fast_now());
+    fast_log[fast_log_n] = 0;
+    CHECK(strcmp(fast_log, "LHhlLlHhLl") == 0, "fast: ran %s, wanted LHhlLlHhLl", fast_log);
+    CHECK(fast_task_misses(lo) == 1 && fast_overruns() == 1,
+            "fast: lo %u misses, %u overruns after, wanted 1 1",
+            fast_task_misses(lo), fast_overruns());
+#ifdef PROFILE_TASKS
+    p = fast_task_profile(hi);
+    CHECK(p->count == 2 && p->min == HI_CYCLES && p->max == HI_CYCLES,
+            "fast: hi profile %u runs %u to %u cycles, wanted 2 of %u",
+            p->count, p->min, p->max, HI_CYCLES);
+    p = fast_task_profile(lo);
+    CHECK(p->count == 3 && p->min == LO_CYCLES && p->max == LO_CYCLES + HI_CYCLES,
+            "fast: lo profile %u runs %u to %u cycles, wanted 3, %u to %u",
+            p->count, p->min, p->max, LO_CYCLES, LO_CYCLES + HI_CYCLES);
+#endif
+    fast_remove_task(hi);
+    fast_remove_task(lo);
+    scheduler_set_overrun_policy(OVERRUN_POLICY);
+}
+
+// --- software timers ---
+
+#define SW_FIRES 8
+
+static uint32_t sw_n;
+static uintptr_t sw_id[SW_FIRES];
+static uint64_t sw_at[SW_FIRES];
+
+static void sw_note(void * arg){
+    if (sw_n < SW_FIRES){
+        sw_id[sw_n] = (uintptr_t)arg;
+        sw_at[sw_n] = stub_core;
+    }
+    sw_n++;
+}
+
+static void check_swtimer(void){
+    /* One shots 300, 200, 100 and 200us from the same moment, started in
+     * that order: they fire 100, 200 (the one started first), 200, 300us
+     * on, each up to a Timer 2 count late. Then one every 100us, held off
+     * for 2.5 periods after its first: it fires once, late, skips 2
+     * periods and is back on the beat. */
+    static const uint32_t delay[4] = { 300, 200, 100, 200 };
+    static const uintptr_t order[4] = { 2, 1, 3, 0 };
+    uint32_t h[4], p, i, missed;
+    uint64_t start;
+
+    for (i = 0; i < 4; i++){
+        h[i] = swtimer_add(sw_note, (void *)(uintptr_t)i);
+    }
+    start = stub_core;
+    for (i = 0; i < 4; i++){
+        swtimer_start(h[i], delay[i], 0);
+    }
+    main_loop(400 * US_CYCLES);
+    CHECK(sw_n == 4, "swtimer: %u one shots fired, wanted 4", sw_n);
+    for (i = 0; i < sw_n && i < 4; i++){
+        uint64_t due = start + delay[order[i]] * US_CYCLES;
+        CHECK(sw_id[i] == order[i] && sw_at[i] >= due && sw_at[i] < due + T2_CYCLES,
+                "swtimer: fire %u was %u at +%u cycles, wanted %u at +%u",
+                i, (uint32_t)sw_id[i], (uint32_t)(sw_at[i] - start),
+                (uint32_t)order[i], (uint32_t)(due - start));
+    }
+    CHECK(!stub_t2_on, "swtimer: Timer 2 left on with no timer running");
+
+    p = h[0];
+    sw_n = 0;
+    missed = swtimer_missed();
+    start = stub_core;
+    swtimer_start(p, 100, 100);
+    main_loop(150 * US_CYCLES);
+    stub_t2_held = 1;
+    main_loop(250 * US_CYCLES);
+    stub_t2_held = 0;
+    main_loop(200 * US_CYCLES);
+    swtimer_stop(p);
+    CHECK(sw_n == 4, "swtimer: periodic fired %u times, wanted 4", sw_n);
+    CHECK(swtimer_missed() - missed == 2, "swtimer: %u periods missed, wanted 2",
+            swtimer_missed() - missed);
+    if (sw_n == 4){
+        CHECK(sw_at[1] == start + 400 * US_CYCLES, "swtimer: held fire at +%u us, wanted +400",
+                (uint32_t)((sw_at[1] - start) / US_CYCLES));
+        for (i = 2; i < 4; i++){
+            uint64_t due = start + (300 + 100 * i) * US_CYCLES;
+            CHECK(sw_at[i] >= due && sw_at[i] < due + T2_CYCLES,
+                    "swtimer: fire %u at +%u cycles, wanted +%u", i,
+                    (uint32_t)(sw_at[i] - start), (uint32_t)(due - start));
+        }
+    }
+    for (i = 0; i < 4; i++){
+        swtimer_remove(h[i]);
+    }
+}
+
+int main(void){
+    init_debug_uart();
+    init_debug_log();
+    check_tickless();
+    check_fast();
+    check_swtimer();
+    errors += stub_errors;
+    printf("%u errors\n", errors);
+    return errors ? 1 : 0;
+}
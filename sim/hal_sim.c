@@ -0,0 +1,543 @@
+/*
+ * File:   hal_sim.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ * Linux simulation backend. See hal_sim.h for the model.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "initialise.h"
+#include "debug_uart.h"
+#include "debug_log.h"
+#include "trace.h"
+#include "timestamp.h"
+#include "stack.h"
+
+#define SIM_T1_SIGNAL   (SIGRTMIN)
+#define SIM_T2_SIGNAL   (SIGRTMIN + 1)
+#define SIM_T3_SIGNAL   (SIGRTMIN + 2)
+#define SIM_RX_SIGNAL   (SIGRTMIN + 3)  // stdin has input (F_SETSIG)
+#define SIM_DMA_SIGNAL  (SIGUSR1)     // not queued, so kicks merge like IFS bits
+#define NS_PER_SEC      1000000000ULL
+
+// the tick ISR lives in scheduler.c, and Timer 2 in swtimer.c
+void Timer1Tick(void);
+void Timer2Tick(void) __attribute__((weak));
+// the fast tier ISR in fast_tier.c
+void FastTick(void) __attribute__((weak));
+// and the DMA ISR in debug_uart.c, with DEBUG_UART_DMA
+void DebugUartDma(void) __attribute__((weak));
+// the UART 1 receive ISR in console.c, with DEBUG_CONSOLE
+void Uart1Rx(void) __attribute__((weak));
+
+volatile uint8_t sim_run_led = 0;
+volatile uint8_t sim_debug_pin = 0;
+
+static timer_t t1_timer;
+static timer_t t2_timer;
+static timer_t t3_timer;
+static uint32_t t3_period;              // PR3
+static uint64_t t3_start_ns;            // when Timer 3 was started
+static timer_t dma_timer;
+static uint32_t t1_period = SYSTEM_TICK_TIMER;  // PR1
+static volatile uint64_t t1_start_ns;   // when TMR1 last rolled over
+static volatile uint64_t t1_next_ns;    // when it will next
+static volatile uint64_t t1_ticks;
+static uint64_t sim_end_ns;
+static uint64_t sim_start_ns;
+
+static uint64_t uart_free_ns;       // time the last queued char leaves the FIFO
+static uint64_t uart_char_ns;
+static uint64_t uart_chars;
+static char uart_out[256];
+static uint32_t uart_out_len;
+static uint8_t rx_fifo[SIM_UART_FIFO];
+static uint32_t rx_head, rx_tail;
+static int32_t rx_eof;
+static uint64_t dma_end_ns;         // block complete (CHBCIF) sets then
+static uint64_t dma_clear_ns;       // and was last cleared then
+static uint64_t dma_transfers;
+
+static sigset_t int_signals;
+
+// --- TIME ---
+
+uint64_t sim_time_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+uint64_t hal_core_timer64(void){
+    /* CP0 Count, CORE_TIMER_HZ (SYSCLK / 2), from the start of the run, off
+     * the monotonic clock. Whole seconds apart, or ns * Hz overflows after
+     * 12 minutes. */
+    uint64_t ns = sim_time_ns() - sim_start_ns;
+    return (ns / NS_PER_SEC) * CORE_TIMER_HZ
+            + (ns % NS_PER_SEC) * CORE_TIMER_HZ / NS_PER_SEC;
+}
+
+uint32_t hal_core_timer(void){
+    return (uint32_t)hal_core_timer64();
+}
+
+static uint64_t counts_to_ns(uint32_t counts, uint32_t prescale){
+    return (uint64_t)counts * prescale * NS_PER_SEC / SIM_PBCLK_HZ;
+}
+
+static void arm_timer(timer_t t, uint64_t ns, int32_t absolute){
+    struct itimerspec its;
+    memset(&its, 0, sizeof its);
+    its.it_value.tv_sec = ns / NS_PER_SEC;
+    its.it_value.tv_nsec = ns % NS_PER_SEC;
+    timer_settime(t, absolute ? TIMER_ABSTIME : 0, &its, NULL);
+}
+
+// --- TIMER 1 ---
+
+static void t1_arm(void){
+    /* Timer 1 counts 0..PR1, so a period is PR1 + 1 counts. Rollovers are
+     * kept on an absolute time line, so the tick does not drift. */
+    t1_next_ns = t1_start_ns + counts_to_ns(t1_period + 1, SIM_T1_PRESCALE);
+    arm_timer(t1_timer, t1_next_ns, 1);
+}
+
+static void t1_isr(int sig){
+    (void)sig;
+    t1_start_ns = t1_next_ns;
+    t1_ticks++;
+    t1_arm();
+    Timer1Tick();
+    if (sim_end_ns && t1_start_ns >= sim_end_ns){
+        sim_exit();
+    }
+}
+
+uint32_t hal_tick_timer_count(void){
+    /* TMR1 rolls over at PR1 whether or not the ISR has run yet */
+    uint64_t now = sim_time_ns();
+    uint64_t start = (now >= t1_next_ns) ? t1_next_ns : t1_start_ns;
+    uint64_t counts = (now - start) * SIM_PBCLK_HZ / SIM_T1_PRESCALE / NS_PER_SEC;
+    return (counts > t1_period) ? t1_period : (uint32_t)counts;
+}
+
+uint32_t hal_tick_timer_period(void){
+    return t1_period;
+}
+
+void hal_tick_timer_ack(void){
+    // nothing to do, the signal is the flag
+}
+
+int32_t hal_tick_timer_pending(void){
+    sigset_t set;
+    sigpending(&set);
+    return sigismember(&set, SIM_T1_SIGNAL);
+}
+
+void hal_tick_timer_set_period(uint32_t pr){
+    t1_period = pr;
+    t1_arm();
+}
+
+// --- TIMER 2 ---
+
+static void t2_isr(int sig){
+    (void)sig;
+    if (Timer2Tick){
+        Timer2Tick();
+    }
+}
+
+void hal_timer2_start(uint32_t pr){
+    arm_timer(t2_timer, counts_to_ns(pr + 1, SIM_T2_PRESCALE), 0);
+}
+
+void hal_timer2_stop(void){
+    arm_timer(t2_timer, 0, 0);
+}
+
+void hal_timer2_ack(void){
+}
+
+// --- TIMER 3 ---
+
+static void t3_isr(int sig){
+    (void)sig;
+    if (FastTick){
+        FastTick();
+    }
+}
+
+void hal_fast_timer_start(uint32_t pr){
+    struct itimerspec its;
+    uint64_t ns = counts_to_ns(pr + 1, SIM_T3_PRESCALE);
+    t3_period = pr;
+    t3_start_ns = sim_time_ns();
+    its.it_value.tv_sec = ns / NS_PER_SEC;
+    its.it_value.tv_nsec = ns % NS_PER_SEC;
+    its.it_interval = its.it_value;
+    timer_settime(t3_timer, 0, &its, NULL);
+}
+
+void hal_fast_timer_stop(void){
+    arm_timer(t3_timer, 0, 0);
+}
+
+uint32_t hal_fast_timer_count(void){
+    uint64_t counts = (sim_time_ns() - t3_start_ns) * SIM_PBCLK_HZ / SIM_T3_PRESCALE / NS_PER_SEC;
+    return (uint32_t)(counts % (t3_period + 1));
+}
+
+uint32_t hal_fast_timer_period(void){
+    return t3_period;
+}
+
+void hal_fast_timer_ack(void){
+}
+
+uint32_t hal_fast_nest_begin(void){
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIM_T3_SIGNAL);
+    sigprocmask(SIG_UNBLOCK, &set, NULL);
+    return 0;
+}
+
+void hal_fast_nest_end(uint32_t s){
+    sigset_t set;
+    (void)s;
+    sigemptyset(&set);
+    sigaddset(&set, SIM_T3_SIGNAL);
+    sigprocmask(SIG_BLOCK, &set, NULL);
+}
+
+// --- UART 1 ---
+
+static void uart_flush(void){
+    if (uart_out_len){
+        ssize_t r = write(STDOUT_FILENO, uart_out, uart_out_len);
+        (void)r;
+        uart_out_len = 0;
+    }
+}
+
+static int32_t rx_fill(void){
+    /* Up to a FIFO of chars from stdin, without blocking. Returns the
+     * number read. */
+    struct pollfd p = { STDIN_FILENO, POLLIN, 0 };
+    int32_t n = 0;
+    while (!rx_eof && rx_head - rx_tail < SIM_UART_FIFO && poll(&p, 1, 0) > 0){
+        uint8_t c;
+        if (read(STDIN_FILENO, &c, 1) != 1){
+            rx_eof = 1;     // or an error, either way no more
+            break;
+        }
+        rx_fifo[rx_head++ % SIM_UART_FIFO] = c;
+        n++;
+    }
+    return n;
+}
+
+static void rx_isr(int sig){
+    /* Input on stdin: give it to the ISR a FIFO full at a time, until there
+     * is no more, so a long paste cannot overrun. */
+    (void)sig;
+    while (rx_fill() > 0){
+        if (Uart1Rx){
+            Uart1Rx();
+        } else {
+            rx_tail = rx_head;
+        }
+    }
+}
+
+int32_t hal_uart_rx_ready(void){
+    return rx_head != rx_tail;
+}
+
+uint8_t hal_uart_rx(void){
+    return rx_fifo[rx_tail++ % SIM_UART_FIFO];
+}
+
+int32_t hal_uart_rx_overrun(void){
+    return 0;
+}
+
+void hal_uart_rx_ack(void){
+}
+
+// --- DMA channel 0 -> UART 1 ---
+
+static void dma_isr(int sig){
+    (void)sig;
+    if (DebugUartDma){
+        DebugUartDma();
+    }
+}
+
+void hal_uart_dma_start(const uint8_t * src, uint32_t len){
+    /* The bytes go out at the link rate behind anything already queued;
+     * block complete is signalled when the last one has left. */
+    uint32_t i;
+    for (i = 0; i < len; i++){
+        hal_uart_tx(src[i]);
+    }
+    uart_flush();
+    dma_transfers++;
+    dma_end_ns = uart_free_ns;
+    arm_timer(dma_timer, dma_end_ns, 1);
+}
+
+int32_t hal_uart_dma_done(void){
+    // CHBCIF: set at the end of the block, if not cleared since
+    return dma_end_ns > dma_clear_ns && sim_time_ns() >= dma_end_ns;
+}
+
+void hal_uart_dma_done_ack(void){
+    /* Clears CHBCIF whatever it is, like DCH0INTCLR: a block that is
+     * still going sets it when it ends, one that has ended is cleared. */
+    dma_clear_ns = sim_time_ns();
+}
+
+void hal_uart_dma_ack(void){
+    /* DMA0IF is the pending signal, taken on entry to the ISR; a block
+     * that completes from now on raises it again. */
+}
+
+void hal_uart_dma_kick(void){
+    raise(SIM_DMA_SIGNAL);
+}
+
+int32_t hal_uart_dma_irq_pending(void){
+    sigset_t set;
+    sigpending(&set);
+    return sigismember(&set, SIM_DMA_SIGNAL) || hal_uart_dma_done();
+}
+
+int32_t hal_uart_tx_ready(void){
+    uint64_t now = sim_time_ns();
+    return (uart_free_ns <= now + (SIM_UART_FIFO - 1) * uart_char_ns);
+}
+
+void hal_uart_tx(uint8_t c){
+    uint64_t now = sim_time_ns();
+    if (uart_free_ns < now){
+        uart_free_ns = now;
+    }
+    uart_free_ns += uart_char_ns;
+    uart_chars++;
+    uart_out[uart_out_len++] = c;
+    if (c == '\n' || uart_out_len == sizeof uart_out){
+        uart_flush();
+    }
+}
+
+// --- STACK ---
+
+static uint32_t * stack_top;
+static uint32_t * stack_limit;
+
+static void __attribute__((noinline)) stack_reserve(void){
+    /* Bring in the host stack pages for SIM_STACK_BYTES below here, top
+     * down, so stack_paint() has them to paint when this returns. */
+    volatile uint8_t area[SIM_STACK_BYTES];
+    uint32_t i;
+    for (i = 0; i < SIM_STACK_BYTES; i += 1024){
+        area[SIM_STACK_BYTES - 1 - i] = 0;
+    }
+    area[0] = 0;
+    stack_limit = (uint32_t *)(((uintptr_t)area + 3) & ~(uintptr_t)3);
+}
+
+uint32_t * hal_stack_top(void){
+    return stack_top;
+}
+
+uint32_t * hal_stack_limit(void){
+    return stack_limit;
+}
+
+uint32_t hal_ram_size(void){
+    return SIM_RAM_BYTES;
+}
+
+uint32_t hal_ram_static(void){
+    // from the GNU linker
+    extern char __data_start[], _end[];
+    return (uint32_t)(_end - __data_start);
+}
+
+const uint8_t * hal_flash_base(void){
+    extern const uint8_t __executable_start[];
+    return __executable_start;
+}
+
+uint32_t hal_flash_size(void){
+    extern const uint8_t __executable_start[], etext[];
+    return (uint32_t)(etext - __executable_start);
+}
+
+// --- INTERRUPTS ---
+
+void hal_disable_interrupts(void){
+    sigprocmask(SIG_BLOCK, &int_signals, NULL);
+}
+
+void hal_enable_interrupts(void){
+    sigprocmask(SIG_UNBLOCK, &int_signals, NULL);
+}
+
+uint32_t hal_irq_save(void){
+    /* Returns which interrupt signals were blocked already (bit n for
+     * SIGRTMIN + n), so restore unblocks only the others. In an ISR those
+     * are the ones its priority masks. */
+    sigset_t old;
+    uint32_t s = 0, i;
+    sigprocmask(SIG_BLOCK, &int_signals, &old);
+    for (i = 0; i < 32 && SIGRTMIN + (int)i <= SIGRTMAX; i++){
+        if (sigismember(&old, SIGRTMIN + i)){
+            s |= 1UL << i;
+        }
+    }
+    return s;
+}
+
+void hal_irq_restore(uint32_t s){
+    sigset_t set;
+    int sig;
+    sigemptyset(&set);
+    for (sig = SIGRTMIN; sig <= SIGRTMAX && sig - SIGRTMIN < 32; sig++){
+        if (sigismember(&int_signals, sig) && !(s & (1UL << (sig - SIGRTMIN)))){
+            sigaddset(&set, sig);
+        }
+    }
+    sigprocmask(SIG_UNBLOCK, &set, NULL);
+}
+
+void hal_cpu_idle(void){
+    /* WAIT, called with interrupts disabled: sleep until an interrupt
+     * arrives, then leave it pending. Its ISR runs when interrupts are
+     * enabled again, as on the PIC. */
+    siginfo_t info;
+    int sig = sigwaitinfo(&int_signals, &info);
+    if (sig > 0){
+        raise(sig);
+    }
+}
+
+// --- SETUP / TEARDOWN ---
+
+static void install_isr(int sig, void (*isr)(int), timer_t * t, int32_t ipl){
+    /* An ISR is not preempted by one of the same or lower priority */
+    struct sigaction sa;
+    struct sigevent sev;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = isr;
+    sigemptyset(&sa.sa_mask);
+    sigaddset(&sa.sa_mask, SIM_T1_SIGNAL);  // IPL1
+    sigaddset(&sa.sa_mask, SIM_DMA_SIGNAL); // IPL1
+    sigaddset(&sa.sa_mask, SIM_RX_SIGNAL);  // IPL1
+    if (ipl >= 2){
+        sigaddset(&sa.sa_mask, SIM_T2_SIGNAL);
+    }
+    if (ipl >= 3){
+        sigaddset(&sa.sa_mask, SIM_T3_SIGNAL);
+    }
+    sigaction(sig, &sa, NULL);
+    if (t == NULL){
+        return;
+    }
+    memset(&sev, 0, sizeof sev);
+    sev.sigev_notify = SIGEV_SIGNAL;
+    sev.sigev_signo = sig;
+    timer_create(CLOCK_MONOTONIC, &sev, t);
+}
+
+void sim_exit(void){
+    char msg[256];
+    int32_t n;
+    double secs = (sim_time_ns() - sim_start_ns) / 1e9;
+    hal_disable_interrupts();
+    uart_flush();
+    n = snprintf(msg, sizeof msg,
+            "\n[sim] %.3fs, %llu timer 1 ints, %llu uart chars (%.0f chars/s, "
+            "link %.2f%% busy), %llu dma transfers\n",
+            secs, (unsigned long long)t1_ticks,
+            (unsigned long long)uart_chars, uart_chars / secs,
+            100.0 * uart_chars * uart_char_ns / (secs * NS_PER_SEC),
+            (unsigned long long)dma_transfers);
+    if (n > 0){
+        ssize_t r = write(STDERR_FILENO, msg, n);
+        (void)r;
+    }
+    _exit(0);
+}
+
+static void sigint_handler(int sig){
+    (void)sig;
+    sim_exit();
+}
+
+void initialise(void){
+    /* Host stand-in for initialise.c. Interrupts come up disabled, like the
+     * PIC32 after __builtin_disable_interrupts() in main(). */
+    const char * secs = getenv("SIM_SECONDS");
+    uint32_t top;
+
+    stack_top = &top;
+    stack_reserve();
+    stack_paint();
+
+    sigemptyset(&int_signals);
+    sigaddset(&int_signals, SIM_T1_SIGNAL);
+    sigaddset(&int_signals, SIM_T2_SIGNAL);
+    sigaddset(&int_signals, SIM_T3_SIGNAL);
+    sigaddset(&int_signals, SIM_DMA_SIGNAL);
+    sigaddset(&int_signals, SIM_RX_SIGNAL);
+    hal_disable_interrupts();
+
+    RUN_LED = 0;
+    DEBUG_PIN = 0;
+
+    // 10 bits per char, 1 start 8 data 1 stop
+    uart_char_ns = 10 * NS_PER_SEC / SIM_UART_BAUD;
+
+    install_isr(SIM_T1_SIGNAL, t1_isr, &t1_timer, 1);
+    install_isr(SIM_T2_SIGNAL, t2_isr, &t2_timer, 2);
+    install_isr(SIM_T3_SIGNAL, t3_isr, &t3_timer, 3);
+    install_isr(SIM_DMA_SIGNAL, dma_isr, &dma_timer, 1);
+    install_isr(SIM_RX_SIGNAL, rx_isr, NULL, 1);
+    signal(SIGINT, sigint_handler);
+
+    // stdin raises the RX signal when there is input. Raise it once now
+    // for any that came before this.
+    fcntl(STDIN_FILENO, F_SETOWN, getpid());
+    fcntl(STDIN_FILENO, F_SETSIG, SIM_RX_SIGNAL);
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_ASYNC);
+    raise(SIM_RX_SIGNAL);
+
+    sim_start_ns = sim_time_ns();
+    if (secs){
+        sim_end_ns = sim_start_ns + (uint64_t)(atof(secs) * NS_PER_SEC);
+    }
+    t1_start_ns = sim_start_ns;
+    t1_arm();
+
+    init_timestamp();
+    init_debug_uart();
+    init_debug_log();
+    init_trace();
+}
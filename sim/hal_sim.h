@@ -0,0 +1,116 @@
+/*
+ * File:   hal_sim.h
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ * Linux simulation backend for hal.h. Interrupts are modelled with POSIX
+ * signals, so an "ISR" really does preempt the main loop the way it does on
+ * the PIC32:
+ *  - Timer 1 (IPL1) is a periodic timer that calls Timer1Tick(). Its
+ *    period can be changed on the fly (PR1) like the real one
+ *  - Timer 2 (IPL2) is a one shot timer that calls Timer2Tick(), and blocks
+ *    Timer 1 while it runs
+ *  - Timer 3 (IPL3) is a periodic timer that calls FastTick(), which can
+ *    nest in itself between hal_fast_nest_begin() and hal_fast_nest_end()
+ *  - UART 1 drains at the 921.6 kbaud rate of the real link (8 deep FIFO)
+ *    and writes to stdout
+ *  - UART 1 receives stdin, a FIFO at a time, and calls Uart1Rx() (IPL1)
+ *  - DMA channel 0 (IPL1) sends a block to UART 1 at the same rate and
+ *    calls DebugUartDma() when it is done
+ *  - hal_cpu_idle() (WAIT, interrupts disabled) sleeps until a timer signal
+ *    arrives and leaves it pending
+ * Set SIM_SECONDS in the environment to stop the simulation after that long.
+ */
+
+#ifndef _HAL_SIM_H
+#define _HAL_SIM_H
+
+#include <stdint.h>
+
+#include "clock_config.h"
+
+// the clocks of the real board, used to scale the virtual peripherals
+#define SIM_PBCLK_HZ        PBCLK_HZ
+#define SIM_T1_PRESCALE     TICK_PRESCALE
+#define SIM_T2_PRESCALE     SWTIMER_PRESCALE
+#define SIM_T3_PRESCALE     TICK_PRESCALE
+#define SIM_UART_BAUD       DEBUG_BAUD_ACTUAL
+#define SIM_UART_FIFO       8
+#define SIM_STACK_BYTES     65536
+#define SIM_RAM_BYTES       131072  // PIC32MX795F512L
+
+// ISR attributes mean nothing on the host
+#define __ISR(vector, ipl)
+
+// virtual pins
+extern volatile uint8_t sim_run_led;
+extern volatile uint8_t sim_debug_pin;
+#define RUN_LED sim_run_led
+#define DEBUG_PIN sim_debug_pin
+
+// Timer 1 (Task Scheduler Ticks)
+uint32_t hal_tick_timer_count(void);
+uint32_t hal_tick_timer_period(void);
+void hal_tick_timer_ack(void);
+int32_t hal_tick_timer_pending(void);
+void hal_tick_timer_set_period(uint32_t pr);
+
+// Timer 2 (one shot, the software timer service in swtimer.c)
+void hal_timer2_start(uint32_t pr);
+void hal_timer2_stop(void);
+void hal_timer2_ack(void);
+
+// Timer 3 (fast tier ticks, IPL3)
+void hal_fast_timer_start(uint32_t pr);
+void hal_fast_timer_stop(void);
+uint32_t hal_fast_timer_count(void);
+uint32_t hal_fast_timer_period(void);
+void hal_fast_timer_ack(void);
+uint32_t hal_fast_nest_begin(void);
+void hal_fast_nest_end(uint32_t s);
+
+// UART 1 (debug print)
+int32_t hal_uart_tx_ready(void);
+void hal_uart_tx(uint8_t c);
+int32_t hal_uart_rx_ready(void);
+uint8_t hal_uart_rx(void);
+int32_t hal_uart_rx_overrun(void);
+void hal_uart_rx_ack(void);
+
+// DMA channel 0 -> UART 1 TX (DEBUG_UART_DMA)
+void hal_uart_dma_start(const uint8_t * src, uint32_t len);
+int32_t hal_uart_dma_done(void);
+void hal_uart_dma_done_ack(void);
+void hal_uart_dma_ack(void);
+void hal_uart_dma_kick(void);
+int32_t hal_uart_dma_irq_pending(void);
+
+// CP0 Count, the core timer (SYSCLK / 2), and all 64 bits of it for
+// timestamp_now(), which has no need to extend it in software
+uint32_t hal_core_timer(void);
+uint64_t hal_core_timer64(void);
+#define HAL_CORE_TIMER64
+
+// the SIM_STACK_BYTES of host stack below initialise()
+uint32_t * hal_stack_top(void);
+uint32_t * hal_stack_limit(void);
+// SIM_RAM_BYTES, and the host program's own data and bss
+uint32_t hal_ram_size(void);
+uint32_t hal_ram_static(void);
+// the host program's text, for the program flash
+const uint8_t * hal_flash_base(void);
+uint32_t hal_flash_size(void);
+
+// interrupts
+void hal_disable_interrupts(void);
+void hal_enable_interrupts(void);
+uint32_t hal_irq_save(void);
+void hal_irq_restore(uint32_t s);
+void hal_cpu_idle(void);
+
+// simulation only
+uint64_t sim_time_ns(void);
+void sim_exit(void);
+
+#endif // _HAL_SIM_H
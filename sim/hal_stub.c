@@ -0,0 +1,107 @@
+/*
+ * File:   hal_stub.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ * hal.h for the host suites, see hal_stub.h. Linked into check_suite and
+ * bench_suite, in place of hal_sim.c.
+ */
+
+#include <stdio.h>
+
+#include "hal.h"
+#include "hal_stub.h"
+
+// the ISR's in scheduler.c and swtimer.c, run by stub_elapse()
+void Timer1Tick(void);
+void Timer2Tick(void);
+
+volatile uint8_t sim_run_led = 0;
+volatile uint8_t sim_debug_pin = 0;
+
+uint64_t stub_core;
+uint64_t stub_t1_start;
+uint32_t stub_pr1 = SYSTEM_TICK_TIMER;
+uint32_t stub_t2_on;
+uint32_t stub_t2_held;
+uint32_t stub_errors;
+
+static uint64_t t2_due;         // stub_core when TMR2 next matches PR2
+static uint32_t pr2;
+
+uint32_t hal_core_timer(void){ return (uint32_t)stub_core; }
+uint64_t hal_core_timer64(void){ return stub_core; }
+
+uint32_t hal_tick_timer_count(void){
+    uint64_t counts = (stub_core - stub_t1_start) / T1_CYCLES;
+    return (counts > stub_pr1) ? stub_pr1 : (uint32_t)counts;
+}
+
+uint32_t hal_tick_timer_period(void){ return stub_pr1; }
+void hal_tick_timer_ack(void){ }
+// the ISR's run as soon as they are due, so none is ever left pending
+int32_t hal_tick_timer_pending(void){ return 0; }
+
+void hal_tick_timer_set_period(uint32_t pr){
+    if (pr < hal_tick_timer_count()){
+        printf("ERROR PR1 %u set below TMR1 %u\n", pr, hal_tick_timer_count());
+        stub_errors++;
+    }
+    stub_pr1 = pr;
+}
+
+void hal_timer2_start(uint32_t pr){
+    pr2 = pr;
+    t2_due = stub_core + (uint64_t)(pr + 1) * T2_CYCLES;
+    stub_t2_on = 1;
+}
+
+void hal_timer2_stop(void){ stub_t2_on = 0; }
+void hal_timer2_ack(void){ }
+void hal_fast_timer_start(uint32_t pr){ (void)pr; }
+void hal_fast_timer_stop(void){ }
+uint32_t hal_fast_timer_count(void){ return 0; }
+uint32_t hal_fast_timer_period(void){ return 0; }
+void hal_fast_timer_ack(void){ }
+uint32_t hal_fast_nest_begin(void){ return 0; }
+void hal_fast_nest_end(uint32_t s){ (void)s; }
+void hal_uart_dma_start(const uint8_t * src, uint32_t len){ (void)src; (void)len; }
+int32_t hal_uart_dma_done(void){ return 0; }
+void hal_uart_dma_done_ack(void){ }
+void hal_uart_dma_ack(void){ }
+void hal_uart_dma_kick(void){ }
+int32_t hal_uart_dma_irq_pending(void){ return 0; }
+// nearly free on the M4K, but the compiler may not move memory across it
+void hal_disable_interrupts(void){ __asm__ volatile ("" ::: "memory"); }
+void hal_enable_interrupts(void){ __asm__ volatile ("" ::: "memory"); }
+void hal_cpu_idle(void){ }
+uint32_t hal_irq_save(void){ return 0; }
+void hal_irq_restore(uint32_t s){ (void)s; }
+// the demo CRC job reads the program flash
+static const uint8_t flash[8192];
+const uint8_t * hal_flash_base(void){ return flash; }
+uint32_t hal_flash_size(void){ return sizeof flash; }
+
+void stub_elapse(uint64_t cycles){
+    /* Move the clock on, running Timer1Tick() at each roll over, and
+     * Timer2Tick() when Timer 2 matches, or as soon as it is let in after
+     * being held off. Timer 2 goes first, at IPL2. */
+    uint64_t end = stub_core + cycles;
+    for (;;){
+        uint64_t t1 = stub_t1_start + (uint64_t)(stub_pr1 + 1) * T1_CYCLES;
+        uint64_t t2 = (t2_due > stub_core) ? t2_due : stub_core;
+        if (stub_t2_on && !stub_t2_held && t2 <= end && t2 <= t1){
+            stub_core = t2;
+            t2_due += (uint64_t)(pr2 + 1) * T2_CYCLES;
+            Timer2Tick();
+        } else if (t1 <= end){
+            stub_core = t1;
+            stub_t1_start = stub_core;
+            Timer1Tick();
+        } else {
+            break;
+        }
+    }
+    stub_core = end;
+}
@@ -0,0 +1,40 @@
+/*
+ * File:   hal_stub.h
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ * The hardware for the host suites, stubbed out in hal_stub.c in place of
+ * hal_sim.c: no signals, no threads, and a scripted clock. The core timer,
+ * Timer 1 and Timer 2 only move when stub_elapse() moves them, and their
+ * ISR's run when they come due, so a suite that never moves it sees a
+ * stopped clock. The UART is left to each suite, to count or drop what it
+ * is sent.
+ */
+
+#ifndef _HAL_STUB_H
+#define _HAL_STUB_H
+
+#include <stdint.h>
+
+#include "initialise.h"
+#include "timestamp.h"
+#include "swtimer.h"
+
+// core timer cycles in a Timer 1 count, and in a tick
+#define T1_CYCLES   TIMESTAMP_PER_TICK_COUNT
+#define TICK_CYCLES ((uint64_t)(SYSTEM_TICK_TIMER + 1) * T1_CYCLES)
+// and in a Timer 2 count
+#define T2_CYCLES   (CORE_TIMER_HZ / SWTIMER_HZ)
+
+extern uint64_t stub_core;      // CP0 Count, 64 bits
+extern uint64_t stub_t1_start;  // stub_core when TMR1 last rolled over
+extern uint32_t stub_pr1;
+extern uint32_t stub_t2_on;
+extern uint32_t stub_t2_held;   // Timer 2 interrupt masked
+// PR1 set below TMR1, each printed as it happens
+extern uint32_t stub_errors;
+
+void stub_elapse(uint64_t cycles);
+
+#endif
@@ -0,0 +1,146 @@
+/*
+ * File:   ram_report.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ * Link time report of static RAM by module: the data and bss of each object
+ * file, from nm, with its biggest variables, largest module first. Const
+ * data is in flash and is not counted, by section: .rodata, and the
+ * .data.rel.ro the host compiler puts const data with pointers in (the
+ * console commands, the task table), which XC32 puts in flash.
+ *
+ *   make -C sim ram                        the sim's objects
+ *   sim/ram_report [-n nm] [-b bytes] [-t n] object ...
+ *     -n nm       the nm to run, xc32-nm for the PIC32 objects
+ *     -b bytes    the budget: the exit code is 1 if the total is over it
+ *     -t n        variables shown per module (3)
+ *
+ * For the real figures, run it on the XC32 objects: the sim's are built
+ * for a 64 bit host, so anything with a pointer in it is bigger. The stack
+ * is not in this; see stack.h for that, at run time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_MODULES 64
+#define MAX_VARS    256
+
+typedef struct {
+    char name[48];
+    unsigned long size;
+    char type;
+} var;
+
+typedef struct {
+    const char * path;
+    unsigned long data;     // initialised, D d G g
+    unsigned long bss;      // zeroed, B b S s C
+    unsigned vars;
+    var var[MAX_VARS];
+} module;
+
+static module modules[MAX_MODULES];
+
+static int read_module(module * m, const char * nm){
+    /* nm -f sysv gives name, value, type, size and section for each
+     * symbol, one per line between bars */
+    char cmd[512], line[512];
+    FILE * f;
+    snprintf(cmd, sizeof cmd, "%s -f sysv --defined-only '%s'", nm, m->path);
+    f = popen(cmd, "r");
+    if (!f){
+        perror(nm);
+        return 0;
+    }
+    while (fgets(line, sizeof line, f)){
+        unsigned long value, size;
+        char type, name[256], section[64];
+        if (sscanf(line, "%255s |%lx| %c |%*[^|]|%lx|%*[^|]|%63s",
+                name, &value, &type, &size, section) != 5){
+            continue;   // no size: a label or a heading
+        }
+        if (strncmp(section, ".data.rel.ro", 12) == 0){
+            continue;   // const, in flash on the target
+        }
+        if (strchr("DdGg", type)){
+            m->data += size;
+        } else if (strchr("BbSsC", type)){
+            m->bss += size;
+        } else {
+            continue;
+        }
+        if (m->vars < MAX_VARS){
+            var * v = &m->var[m->vars++];
+            snprintf(v->name, sizeof v->name, "%.47s", name);
+            v->size = size;
+            v->type = type;
+        }
+    }
+    return pclose(f) == 0;
+}
+
+static int by_size(const void * a, const void * b){
+    unsigned long x = ((const var *)a)->size, y = ((const var *)b)->size;
+    return (x < y) - (x > y);
+}
+
+static int by_total(const void * a, const void * b){
+    const module * x = a, * y = b;
+    unsigned long tx = x->data + x->bss, ty = y->data + y->bss;
+    return (tx < ty) - (tx > ty);
+}
+
+int main(int argc, char ** argv){
+    const char * nm = "nm";
+    unsigned long budget = 0, data = 0, bss = 0;
+    unsigned n = 0, top = 3, i, j;
+
+    for (i = 1; i < (unsigned)argc; i++){
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < (unsigned)argc){
+            nm = argv[++i];
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < (unsigned)argc){
+            budget = strtoul(argv[++i], 0, 0);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < (unsigned)argc){
+            top = atoi(argv[++i]);
+        } else if (n < MAX_MODULES){
+            modules[n++].path = argv[i];
+        }
+    }
+    if (n == 0){
+        fprintf(stderr, "usage: %s [-n nm] [-b bytes] [-t n] object ...\n", argv[0]);
+        return 2;
+    }
+    for (i = 0; i < n; i++){
+        if (!read_module(&modules[i], nm)){
+            fprintf(stderr, "%s: nm failed\n", modules[i].path);
+            return 2;
+        }
+        qsort(modules[i].var, modules[i].vars, sizeof(var), by_size);
+    }
+    qsort(modules, n, sizeof(module), by_total);
+
+    printf("%-24s %7s %7s %7s\n", "module", "data", "bss", "total");
+    for (i = 0; i < n; i++){
+        const module * m = &modules[i];
+        const char * base = strrchr(m->path, '/');
+        printf("%-24s %7lu %7lu %7lu\n", base ? base + 1 : m->path,
+                m->data, m->bss, m->data + m->bss);
+        for (j = 0; j < top && j < m->vars; j++){
+            printf("  %-22s %7lu %c\n", m->var[j].name, m->var[j].size, m->var[j].type);
+        }
+        data += m->data;
+        bss += m->bss;
+    }
+    printf("%-24s %7lu %7lu %7lu\n", "total", data, bss, data + bss);
+    if (budget){
+        if (data + bss > budget){
+            printf("OVER the %lu byte budget by %lu\n", budget, data + bss - budget);
+            return 1;
+        }
+        printf("within the %lu byte budget, %lu spare\n", budget, budget - data - bss);
+    }
+    return 0;
+}
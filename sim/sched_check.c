@@ -0,0 +1,174 @@
+/*
+ * File:   sched_check.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ * Offline schedulability check of the task table (task_table.h), built with
+ * the same build options as the scheduler. Over the hyperperiod of the task
+ * periods it works out the load on every tick, in Timer 1 counts, and checks
+ * the worst against the tick (SYSTEM_TICK_TIMER + 1 counts). It also works
+ * out the worst tick for debug print output, the time the UART needs to
+ * send it, and whether the print buffer can keep up.
+ *
+ *   make -C sim check                      check with the table's WCETs
+ *   sim/sched_check [-o counts] [log]
+ *     -o counts   scheduler overhead to allow per tick
+ *     log         debug output with "P<task> n<calls> min/mean/max" profile
+ *                 lines: the max (core timer cycles, rounded up to Timer 1
+ *                 counts) is the WCET of any task the table leaves 0
+ *
+ * Exits 0 if the task set fits, 1 if not, or if any task has no WCET from
+ * the table or the log: a load with holes in it proves nothing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "initialise.h"
+#include "scheduler.h"
+#include "timestamp.h"
+
+#define MAX_HYPERPERIOD 10000000ULL
+// must match debug_uart.c
+#define PRINT_BUF_SIZE  256
+
+typedef struct {
+    const char * name;
+    uint32_t period;
+    uint32_t offset;
+    uint32_t wcet;
+    uint32_t chars;
+    const char * src;
+} entry;
+
+static entry table[] = {
+#define TASK(fn, period, offset, wcet, chars) \
+    { #fn, (period), (offset), (wcet), (chars), (wcet) ? "table" : "none" },
+#include "task_table.h"
+#undef TASK
+};
+#define NUM_ENTRIES (sizeof table / sizeof table[0])
+
+static uint64_t gcd(uint64_t a, uint64_t b){
+    while (b){
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static void read_log(const char * path){
+    /* Take the largest max seen for each task from the profile lines */
+    char line[256];
+    FILE * f = fopen(path, "r");
+    if (!f){
+        perror(path);
+        exit(2);
+    }
+    while (fgets(line, sizeof line, f)){
+        unsigned id, n, min, mean, max;
+        char * p = strchr(line, 'P');
+        if (p && sscanf(p, "P%u n%u %u/%u/%u", &id, &n, &min, &mean, &max) == 5
+                && id < NUM_ENTRIES && strcmp(table[id].src, "table") != 0){
+            table[id].src = "log";
+            max = timestamp_to_tick_counts(max); // profile is in core timer cycles
+            if (max > table[id].wcet){
+                table[id].wcet = max;
+            }
+        }
+    }
+    fclose(f);
+}
+
+int main(int argc, char ** argv){
+    const uint32_t budget = SYSTEM_TICK_TIMER + 1;
+    // Timer 1 counts per char on the debug UART, 10 bits per char
+    const double char_counts = 10.0 * SIM_PBCLK_HZ / SIM_T1_PRESCALE / SIM_UART_BAUD;
+    const uint32_t chars_per_tick = (uint32_t)(budget / char_counts);
+    uint32_t overhead = 0;
+    uint64_t h = 1, t, sum = 0;
+    uint32_t i, worst = 0, worst_chars = 0, backlog = 0, backlog_max = 0;
+    uint64_t worst_at = 0, chars_at = 0;
+    int32_t pass = 1, capped = 0, unknown = 0;
+
+    for (i = 1; i < (uint32_t)argc; i++){
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < (uint32_t)argc){
+            overhead = atoi(argv[++i]);
+        } else {
+            read_log(argv[i]);
+        }
+    }
+
+    printf("%-24s %7s %6s %6s %-5s %5s\n", "task", "period", "offset", "wcet", "src", "chars");
+    for (i = 0; i < NUM_ENTRIES; i++){
+        const entry * e = &table[i];
+        printf("%-24s %7u %6u %6u %-5s %5u\n", e->name, e->period, e->offset,
+                e->wcet, e->src, e->chars);
+        if (e->wcet == 0){
+            unknown++;
+        }
+        h = h / gcd(h, e->period) * e->period;
+        if (h > MAX_HYPERPERIOD){
+            h = MAX_HYPERPERIOD;
+            capped = 1;
+        }
+    }
+
+    /* Steady state: task i is released on the ticks where
+     * t % period == offset % period (its first release is period + offset) */
+    for (t = 0; t < h; t++){
+        uint32_t load = overhead, chars = 0;
+        for (i = 0; i < NUM_ENTRIES; i++){
+            if (t % table[i].period == table[i].offset % table[i].period){
+                load += table[i].wcet;
+                chars += table[i].chars;
+            }
+        }
+        sum += load;
+        if (load > worst){
+            worst = load;
+            worst_at = t;
+        }
+        if (chars > worst_chars){
+            worst_chars = chars;
+            chars_at = t;
+        }
+        // the UART sends at most chars_per_tick, the buffer holds the rest
+        backlog += chars;
+        if (backlog > backlog_max){
+            backlog_max = backlog;
+        }
+        backlog = (backlog > chars_per_tick) ? backlog - chars_per_tick : 0;
+    }
+
+    printf("\nhyperperiod  %llu ticks (%.1f s)%s\n", (unsigned long long)h,
+            (double)h / SYSTEM_TICKS_PER_SEC, capped ? ", capped" : "");
+    printf("tick budget  %u counts, %u allowed for overhead\n", budget, overhead);
+    printf("worst tick   %u counts (%u%%) at tick %llu, slack %d counts\n", worst,
+            worst * 100 / budget, (unsigned long long)worst_at, (int32_t)(budget - worst));
+    printf("mean load    %.1f counts (%.1f%%)\n", (double)sum / h, 100.0 * sum / h / budget);
+    printf("debug print  worst tick %u chars at tick %llu, %.0f counts to send (%.2f ticks)\n",
+            worst_chars, (unsigned long long)chars_at, worst_chars * char_counts,
+            worst_chars * char_counts / budget);
+    printf("             buffer peak %u of %u chars\n", backlog_max, PRINT_BUF_SIZE);
+    if (unknown){
+        printf("FAIL: %d task(s) with no WCET, counted as 0. Give it in the table, or a log.\n",
+                unknown);
+        pass = 0;
+    }
+    if (worst > budget){
+        printf("FAIL: worst tick overruns by %u counts\n", worst - budget);
+        pass = 0;
+    }
+    if (backlog_max > PRINT_BUF_SIZE){
+        printf("FAIL: debug print buffer overflows\n");
+        pass = 0;
+    }
+    if (pass){
+        printf("PASS\n");
+    }
+    return pass ? 0 : 1;
+}
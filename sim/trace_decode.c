@@ -0,0 +1,349 @@
+/*
+ * File:   trace_decode.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ * Host tool: pulls the trace frames (see trace.h) out of a capture of the
+ * debug UART and writes them as a timeline, either Chrome trace JSON (open
+ * in chrome://tracing or ui.perfetto.dev) or VCD (GTKWave). Tasks are on one
+ * track, each ISR on its own with the fast tier tasks inside Timer 3, and
+ * debug_log() records, dropped prints, lost events and marks are instants.
+ * The text in the capture can be kept in a file of its own.
+ *
+ *   make -C sim clean && make -C sim DEFS=-DTRACE_EVENTS all trace_decode
+ *   SIM_SECONDS=3 sim/max32_sim > capture.bin
+ *   sim/trace_decode [-f json|vcd] [-c core_hz] [-t text.txt] capture.bin > out
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "clock_config.h"
+
+#define DEFAULT_CORE_HZ ((double)CORE_TIMER_HZ)
+#define MAX_IDS 256
+
+typedef struct {
+    uint64_t time;      // core timer counts, unwrapped
+    uint32_t seq;       // order in the capture, for a stable sort
+    uint8_t type;
+    uint8_t id;
+    uint16_t arg;
+} event;
+
+static event * events;
+static uint32_t num_events, max_events;
+static uint32_t bad_frames;
+static double core_hz = DEFAULT_CORE_HZ;
+
+static const char * const isr_names[] = { "", "Timer1", "Timer2", "Timer3", "U1RX" };
+#define NUM_ISRS (sizeof isr_names / sizeof isr_names[0])
+
+static void add_event(const uint8_t * f){
+    static uint32_t last;
+    static uint64_t last64;
+    uint32_t t = f[5] | (f[6] << 8) | (f[7] << 16) | ((uint32_t)f[8] << 24);
+    event * e;
+
+    if (num_events == max_events){
+        max_events = max_events ? max_events * 2 : 4096;
+        events = realloc(events, max_events * sizeof events[0]);
+        if (!events){
+            perror("trace_decode");
+            exit(2);
+        }
+    }
+    /* Unwrap the 32 bit timer. Events can be a little out of order (an ISR
+     * traced between a task taking its time and reserving its slot), so
+     * the step is signed. */
+    if (num_events == 0){
+        last64 = t;
+    } else {
+        last64 += (int64_t)(int32_t)(t - last);
+    }
+    last = t;
+    e = &events[num_events];
+    e->time = last64;
+    e->seq = num_events;
+    e->type = f[1];
+    e->id = f[2];
+    e->arg = f[3] | (f[4] << 8);
+    num_events++;
+}
+
+static void read_capture(FILE * in, FILE * text){
+    uint8_t f[TRACE_FRAME_SIZE], check;
+    uint32_t i;
+    int c;
+
+    while ((c = fgetc(in)) != EOF){
+        if (c != TRACE_SYNC){
+            if (text){
+                fputc(c, text);
+            }
+            continue;
+        }
+        f[0] = (uint8_t)c;
+        if (fread(&f[1], 1, TRACE_FRAME_SIZE - 1, in) != TRACE_FRAME_SIZE - 1){
+            bad_frames++;
+            break;
+        }
+        for (check = 0, i = 1; i < TRACE_FRAME_SIZE - 1; i++){
+            check ^= f[i];
+        }
+        if (check != f[TRACE_FRAME_SIZE - 1] || f[1] == 0 || f[1] > TRACE_LOST){
+            bad_frames++;
+            continue;
+        }
+        add_event(f);
+    }
+}
+
+static int by_time(const void * a, const void * b){
+    const event * x = a, * y = b;
+    if (x->time != y->time){
+        return (x->time > y->time) - (x->time < y->time);
+    }
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+// --- Chrome trace JSON ---
+
+// tracks: 0 the tasks, then one per ISR
+static uint32_t track(const event * e){
+    switch (e->type){
+    case TRACE_ISR_ENTER:
+    case TRACE_ISR_EXIT:
+        return e->id;
+    case TRACE_FAST_START:
+    case TRACE_FAST_END:
+        return TRACE_ISR_TIMER3;
+    default:
+        return 0;
+    }
+}
+
+static void write_json(FILE * out){
+    uint64_t t0 = num_events ? events[0].time : 0;
+    uint32_t i;
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+            "\"args\":{\"name\":\"tasks\"}}");
+    for (i = 1; i < NUM_ISRS; i++){
+        fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                "\"args\":{\"name\":\"%s ISR\"}}", i, isr_names[i]);
+    }
+    for (i = 0; i < num_events; i++){
+        const event * e = &events[i];
+        double us = (e->time - t0) * 1e6 / core_hz;
+        char name[32];
+        const char * ph = "i";
+        switch (e->type){
+        case TRACE_TASK_START:
+        case TRACE_TASK_END:
+            snprintf(name, sizeof name, "task %u", e->id);
+            ph = (e->type == TRACE_TASK_START) ? "B" : "E";
+            break;
+        case TRACE_ISR_ENTER:
+        case TRACE_ISR_EXIT:
+            snprintf(name, sizeof name, "%s",
+                    (e->id < NUM_ISRS) ? isr_names[e->id] : "ISR");
+            ph = (e->type == TRACE_ISR_ENTER) ? "B" : "E";
+            break;
+        case TRACE_FAST_START:
+        case TRACE_FAST_END:
+            snprintf(name, sizeof name, "fast %u", e->id);
+            ph = (e->type == TRACE_FAST_START) ? "B" : "E";
+            break;
+        case TRACE_LOG:
+            snprintf(name, sizeof name, "log");
+            break;
+        case TRACE_PRINT_DROP:
+            snprintf(name, sizeof name, "print dropped");
+            break;
+        case TRACE_MARK:
+            snprintf(name, sizeof name, "mark %u", e->id);
+            break;
+        case TRACE_LOST:
+            snprintf(name, sizeof name, "trace lost");
+            break;
+        }
+        fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%u",
+                name, ph, us, track(e));
+        if (ph[0] == 'i'){
+            fprintf(out, ",\"s\":\"%s\",\"args\":{\"arg\":%u}",
+                    (e->type == TRACE_LOST || e->type == TRACE_PRINT_DROP) ? "g" : "t",
+                    e->arg);
+        } else if (ph[0] == 'B'){
+            fprintf(out, ",\"args\":{\"arg\":%u}", e->arg);
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "\n]}\n");
+}
+
+// --- VCD ---
+
+/* One wire per task, ISR and fast task that turns up, high while it runs.
+ * The instants are VCD events, and a mark sets a 16 bit value as well. */
+enum { SIG_TASK, SIG_ISR, SIG_FAST, NUM_KINDS };
+static const char * const kind_names[] = { "task", "isr", "fast" };
+static uint8_t used[NUM_KINDS][MAX_IDS];
+#define SIG_CODE(kind, id) (1 + (kind) * MAX_IDS + (id))
+
+static void vcd_code(char * s, uint32_t n){
+    // printable identifier, base 94 from '!'
+    do {
+        *s++ = (char)('!' + n % 94);
+        n /= 94;
+    } while (n);
+    *s = 0;
+}
+
+static void write_vcd(FILE * out){
+    static const uint32_t instants[] = { TRACE_LOG, TRACE_PRINT_DROP, TRACE_MARK, TRACE_LOST };
+    static const char * const instant_names[] = { "log", "print_dropped", "mark", "trace_lost" };
+    uint64_t t0 = num_events ? events[0].time : 0;
+    uint64_t last = ~0ULL;
+    uint32_t i, k, id;
+    char code[8];
+
+    for (i = 0; i < num_events; i++){
+        const event * e = &events[i];
+        if (e->type == TRACE_TASK_START || e->type == TRACE_TASK_END){
+            used[SIG_TASK][e->id] = 1;
+        } else if (e->type == TRACE_ISR_ENTER || e->type == TRACE_ISR_EXIT){
+            used[SIG_ISR][e->id] = 1;
+        } else if (e->type == TRACE_FAST_START || e->type == TRACE_FAST_END){
+            used[SIG_FAST][e->id] = 1;
+        }
+    }
+    fprintf(out, "$timescale 1ns $end\n$scope module max32 $end\n");
+    for (k = 0; k < NUM_KINDS; k++){
+        for (id = 0; id < MAX_IDS; id++){
+            if (used[k][id]){
+                vcd_code(code, SIG_CODE(k, id));
+                if (k == SIG_ISR && id < NUM_ISRS){
+                    fprintf(out, "$var wire 1 %s %s $end\n", code, isr_names[id]);
+                } else {
+                    fprintf(out, "$var wire 1 %s %s%u $end\n", code, kind_names[k], id);
+                }
+            }
+        }
+    }
+    for (k = 0; k < sizeof instants / sizeof instants[0]; k++){
+        vcd_code(code, SIG_CODE(NUM_KINDS, k));
+        fprintf(out, "$var event 1 %s %s $end\n", code, instant_names[k]);
+    }
+    vcd_code(code, SIG_CODE(NUM_KINDS, MAX_IDS - 1));
+    fprintf(out, "$var wire 16 %s mark_arg $end\n", code);
+    fprintf(out, "$upscope $end\n$enddefinitions $end\n#0\n$dumpvars\n");
+    for (k = 0; k < NUM_KINDS; k++){
+        for (id = 0; id < MAX_IDS; id++){
+            if (used[k][id]){
+                vcd_code(code, SIG_CODE(k, id));
+                fprintf(out, "0%s\n", code);
+            }
+        }
+    }
+    fprintf(out, "$end\n");
+
+    for (i = 0; i < num_events; i++){
+        const event * e = &events[i];
+        uint64_t ns = (uint64_t)((e->time - t0) * 1e9 / core_hz);
+        if (ns != last){
+            fprintf(out, "#%llu\n", (unsigned long long)ns);
+            last = ns;
+        }
+        switch (e->type){
+        case TRACE_TASK_START:
+        case TRACE_TASK_END:
+            vcd_code(code, SIG_CODE(SIG_TASK, e->id));
+            fprintf(out, "%c%s\n", (e->type == TRACE_TASK_START) ? '1' : '0', code);
+            break;
+        case TRACE_ISR_ENTER:
+        case TRACE_ISR_EXIT:
+            vcd_code(code, SIG_CODE(SIG_ISR, e->id));
+            fprintf(out, "%c%s\n", (e->type == TRACE_ISR_ENTER) ? '1' : '0', code);
+            break;
+        case TRACE_FAST_START:
+        case TRACE_FAST_END:
+            vcd_code(code, SIG_CODE(SIG_FAST, e->id));
+            fprintf(out, "%c%s\n", (e->type == TRACE_FAST_START) ? '1' : '0', code);
+            break;
+        default:
+            for (k = 0; k < sizeof instants / sizeof instants[0]; k++){
+                if (instants[k] == e->type){
+                    vcd_code(code, SIG_CODE(NUM_KINDS, k));
+                    fprintf(out, "1%s\n", code);
+                }
+            }
+            if (e->type == TRACE_MARK){
+                vcd_code(code, SIG_CODE(NUM_KINDS, MAX_IDS - 1));
+                fprintf(out, "b");
+                for (k = 16; k--; ){
+                    fputc((e->arg >> k) & 1 ? '1' : '0', out);
+                }
+                fprintf(out, " %s\n", code);
+            }
+            break;
+        }
+    }
+}
+
+int main(int argc, char ** argv){
+    const char * format = "json";
+    FILE * in = stdin, * text = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:c:t:")) != -1){
+        switch (opt){
+        case 'f':
+            format = optarg;
+            break;
+        case 'c':
+            core_hz = atof(optarg);
+            break;
+        case 't':
+            text = fopen(optarg, "w");
+            if (!text){
+                perror(optarg);
+                return 2;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-f json|vcd] [-c core_hz] [-t text_file] [capture]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (optind < argc){
+        in = fopen(argv[optind], "rb");
+        if (!in){
+            perror(argv[optind]);
+            return 2;
+        }
+    }
+    read_capture(in, text);
+    qsort(events, num_events, sizeof events[0], by_time);
+    if (strcmp(format, "vcd") == 0){
+        write_vcd(stdout);
+    } else {
+        write_json(stdout);
+    }
+    fprintf(stderr, "%u events, %.3f s, %u bad frames\n", num_events,
+            num_events ? (events[num_events - 1].time - events[0].time) / core_hz : 0.0,
+            bad_frames);
+    if (text){
+        fclose(text);
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+/*
+ * File:   stack.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#include "stack.h"
+#include "scheduler.h"
+
+static const volatile uint32_t * mark;  // deepest word seen used
+static const volatile uint32_t * scan;  // last checked, going down to the limit
+
+void stack_paint(void){
+    /* From the limit up to a little below this frame. Called once from
+     * initialise(), before the stack has been anywhere deep. */
+    uint32_t * p = hal_stack_limit();
+    uint32_t * end = (uint32_t *)__builtin_frame_address(0) - STACK_PAINT_MARGIN;
+    while (p < end){
+        *p++ = STACK_PAINT;
+    }
+    mark = end;
+    scan = end;
+}
+
+void stack_scan(void){
+    /* The next STACK_SCAN_WORDS down. At the limit the pass is done: start
+     * again below the mark, and check what is left. */
+    const uint32_t * limit = hal_stack_limit();
+    uint32_t n;
+    for (n = 0; n < STACK_SCAN_WORDS && scan > limit; n++){
+        if (*--scan != STACK_PAINT){
+            mark = scan;
+        }
+    }
+    if (scan <= limit){
+        scan = mark;
+        if ((uint32_t)(mark - limit) * sizeof(uint32_t) < STACK_MIN_FREE){
+            fatal_error("Stack nearly full.", stack_high_water());
+        }
+    }
+}
+
+uint32_t stack_size(void){
+    return (uint32_t)(hal_stack_top() - hal_stack_limit()) * sizeof(uint32_t);
+}
+
+uint32_t stack_high_water(void){
+    return (uint32_t)(hal_stack_top() - (const uint32_t *)mark) * sizeof(uint32_t);
+}
+
+void stack_ram_stats(ram_stats * s){
+    s->ram = hal_ram_size();
+    s->static_ram = hal_ram_static();
+    s->stack = stack_size();
+    s->stack_used = stack_high_water();
+}
@@ -0,0 +1,54 @@
+/*
+ * File:   stack.h
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#ifndef _STACK_H
+#define _STACK_H
+
+#include "hal.h"
+
+/* Stack and RAM use. There is one stack, for main, the tasks and every ISR
+ * nested on top of them. stack_paint(), at start up, fills the free part
+ * with STACK_PAINT, and the deepest word that no longer holds it is as far
+ * as the stack has ever reached.
+ *
+ * stack_scan() is called from the main loop in dead time and checks
+ * STACK_SCAN_WORDS more of the painted words on each call, going down from
+ * the deepest seen so far, so new depth just below it is found first. A
+ * whole pass of the free RAM is a few seconds. If the stack comes within
+ * STACK_MIN_FREE bytes of the data below it, that is a fatal error.
+ *
+ * Static RAM (data, bss and heap) is the total from the link. For the
+ * bytes of each module and its biggest arrays, see sim/ram_report. */
+
+#define STACK_PAINT 0x5A7AC3E1
+
+// words below the frame of stack_paint() left alone, for its locals
+#define STACK_PAINT_MARGIN 64
+
+// words per stack_scan(), about 20us @ 48MHz
+#define STACK_SCAN_WORDS 256
+
+// the least free stack allowed, in bytes
+#define STACK_MIN_FREE 1024
+
+typedef struct {
+    uint32_t ram;           // data RAM on the part
+    uint32_t static_ram;    // below the stack: data, bss and heap
+    uint32_t stack;         // from the end of the heap to the top
+    uint32_t stack_used;    // high water, so far as scanned
+} ram_stats;
+
+void stack_paint(void);
+void stack_scan(void);
+// bytes from hal_stack_limit() to hal_stack_top()
+uint32_t stack_size(void);
+// most bytes used, as far as stack_scan() has got
+uint32_t stack_high_water(void);
+void stack_ram_stats(ram_stats * s);
+
+#endif // _STACK_H
@@ -0,0 +1,186 @@
+/*
+ * File:   swtimer.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#include "swtimer.h"
+#include "initialise.h"
+#include "scheduler.h"
+#include "trace.h"
+#include "timestamp.h"
+
+// core timer cycles in one Timer 2 count
+#define CYCLES_PER_COUNT (CORE_TIMER_HZ / SWTIMER_HZ)
+// Timer 2 is 16 bits; PR2 = 0 does not interrupt, so 2 counts at least
+#define MAX_COUNTS 65536
+#define MIN_COUNTS 2
+
+#define NONE 0xFF
+
+typedef char swtimer_max_ok[(SWTIMER_MAX < NONE) ? 1 : -1];
+typedef char swtimer_max_us_ok[(SWTIMER_MAX_US * (CORE_TIMER_HZ / 1000000UL) < 0x40000000UL) ? 1 : -1];
+typedef char swtimer_min_us_ok[(SWTIMER_MIN_PERIOD_US * 1ULL * SWTIMER_HZ >= 4ULL * MIN_COUNTS * 1000000UL) ? 1 : -1];
+
+typedef struct {
+    swtimer_fn fn;          // 0 when the entry is free
+    void * arg;
+    uint32_t deadline;      // timestamp_now32() when due
+    uint32_t period;        // core timer cycles, 0 for one shot
+    uint8_t next;           // in the running list
+    uint8_t active;
+} swtimer;
+
+static swtimer timers[SWTIMER_MAX];
+static uint8_t first = NONE;    // running timers, soonest first
+static uint32_t missed = 0;     // periods skipped
+
+static void check_handle(uint32_t h){
+    if (h >= SWTIMER_MAX || timers[h].fn == 0){
+        fatal_error("Bad software timer.", h);
+    }
+}
+
+static void insert(uint32_t h){
+    /* After any with the same deadline, so those fire in the order they
+     * were started. */
+    uint8_t * p = &first;
+    while (*p != NONE && (int32_t)(timers[*p].deadline - timers[h].deadline) <= 0){
+        p = &timers[*p].next;
+    }
+    timers[h].next = *p;
+    *p = (uint8_t)h;
+    timers[h].active = 1;
+}
+
+static void unlink(uint32_t h){
+    uint8_t * p = &first;
+    while (*p != h){
+        p = &timers[*p].next;
+    }
+    *p = timers[h].next;
+    timers[h].active = 0;
+}
+
+static void arm(void){
+    /* Timer 2 for the first deadline, rounded up so it is never early. One
+     * too far off for 16 bits gets the longest shot, and the ISR sets it
+     * again for the rest. */
+    int32_t dt;
+    uint32_t counts;
+    if (first == NONE){
+        hal_timer2_stop();
+        return;
+    }
+    dt = (int32_t)(timers[first].deadline - timestamp_now32());
+    if (dt <= 0){
+        counts = MIN_COUNTS;
+    } else {
+        counts = ((uint32_t)dt + CYCLES_PER_COUNT - 1) / CYCLES_PER_COUNT;
+        if (counts > MAX_COUNTS){
+            counts = MAX_COUNTS;
+        } else if (counts < MIN_COUNTS){
+            counts = MIN_COUNTS;
+        }
+    }
+    hal_timer2_start(counts - 1);
+}
+
+uint32_t swtimer_add(swtimer_fn fn, void * arg){
+    /* A stopped timer that calls fn(arg); returns its handle. Too many
+     * timers is a configuration fault. */
+    uint32_t h, s;
+    if (fn == 0){
+        fatal_error("Bad software timer.", 0);
+    }
+    s = hal_irq_save();
+    for (h = 0; h < SWTIMER_MAX; h++){
+        if (timers[h].fn == 0){
+            timers[h].arg = arg;
+            timers[h].active = 0;
+            timers[h].fn = fn;
+            hal_irq_restore(s);
+            return h;
+        }
+    }
+    hal_irq_restore(s);
+    fatal_error("Software timers full.", SWTIMER_MAX);
+    return 0;
+}
+
+void swtimer_remove(uint32_t h){
+    swtimer_stop(h);
+    timers[h].fn = 0;
+}
+
+void swtimer_start(uint32_t h, uint32_t delay_us, uint32_t period_us){
+    /* Call back in delay_us and, if period_us is not 0, every period_us
+     * after that. Starting a running timer starts it again from now. */
+    uint32_t s;
+    check_handle(h);
+    if (delay_us > SWTIMER_MAX_US || period_us > SWTIMER_MAX_US){
+        fatal_error("Software timer too long.", h);
+    }
+    if (period_us != 0 && period_us < SWTIMER_MIN_PERIOD_US){
+        fatal_error("Software timer period too short.", h);
+    }
+    s = hal_irq_save();
+    if (timers[h].active){
+        unlink(h);
+    }
+    timers[h].deadline = timestamp_now32() + (uint32_t)timestamp_from_us(delay_us);
+    timers[h].period = (uint32_t)timestamp_from_us(period_us);
+    insert(h);
+    if (first == h){
+        arm();
+    }
+    hal_irq_restore(s);
+}
+
+void swtimer_stop(uint32_t h){
+    /* Stopping one that is not running does nothing. Timer 2 stays set for
+     * the old first deadline if that was this one: it finds nothing due
+     * and sets itself again, which costs less than a reprogram here. */
+    uint32_t s;
+    check_handle(h);
+    s = hal_irq_save();
+    if (timers[h].active){
+        unlink(h);
+    }
+    hal_irq_restore(s);
+}
+
+uint32_t swtimer_active(uint32_t h){
+    check_handle(h);
+    return timers[h].active;
+}
+
+uint32_t swtimer_missed(void){
+    return missed;
+}
+
+void __ISR(_TIMER_2_VECTOR, IPL2AUTO) Timer2Tick(void){
+    /* Every timer that is due, soonest first. A periodic one goes back in
+     * the list before its callback, so the callback can stop it or start
+     * it again. Timer 2 is then set for whatever is first. */
+    uint32_t h, late;
+    trace_event(TRACE_ISR_ENTER, TRACE_ISR_TIMER2, 0);
+    hal_timer2_stop();
+    hal_timer2_ack(); // reset the flag
+    while (first != NONE
+            && (int32_t)(late = timestamp_now32() - timers[first].deadline) >= 0){
+        h = first;
+        unlink(h);
+        if (timers[h].period){
+            uint32_t skip = late / timers[h].period;
+            timers[h].deadline += (skip + 1) * timers[h].period;
+            missed += skip;
+            insert(h);
+        }
+        timers[h].fn(timers[h].arg);
+    }
+    arm();
+    trace_event(TRACE_ISR_EXIT, TRACE_ISR_TIMER2, 0);
+}
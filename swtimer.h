@@ -0,0 +1,53 @@
+/*
+ * File:   swtimer.h
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#ifndef _SWTIMER_H
+#define _SWTIMER_H
+
+#include "hal.h"
+
+/* Software timers: one shot and periodic callbacks to the microsecond, far
+ * finer than the scheduler tick, all on Timer 2. The running timers are
+ * kept in a list sorted by deadline, and Timer 2 is set for the first one
+ * only, so it interrupts once per expiry and not on a fixed beat. With no
+ * timers running it is off.
+ *
+ * Deadlines are core timer timestamps, so a periodic timer does not drift:
+ * each period is from the last deadline, not from when the callback ran.
+ * If a callback is so late that whole periods have gone, they are skipped
+ * and counted (see swtimer_missed()). A timer never fires early; it fires
+ * late by the Timer 2 interrupt latency, plus the other callbacks due at
+ * the same time.
+ *
+ * Callbacks run in the Timer 2 ISR, at IPL2, above every task and Timer 1:
+ * keep them short, and pass anything long to a task with
+ * scheduler_post_event(). The API can be called from main, tasks and the
+ * callbacks, not from the fast tier (IPL3). Timers are added from main or
+ * tasks, at start up as a rule. */
+
+// at most this many timers, running or not
+#define SWTIMER_MAX 8
+
+// longest delay or period, so deadlines compare right across a Count wrap
+#define SWTIMER_MAX_US 20000000UL
+
+// shortest period: a few Timer 2 counts, and the ISR's latency and run
+// time. A shorter one would be late every period, only counting misses,
+// with the CPU stuck in the ISR. A one shot delay can be anything.
+#define SWTIMER_MIN_PERIOD_US 20
+
+typedef void (*swtimer_fn)(void * arg);
+
+uint32_t swtimer_add(swtimer_fn fn, void * arg);
+void swtimer_remove(uint32_t h);
+void swtimer_start(uint32_t h, uint32_t delay_us, uint32_t period_us);
+void swtimer_stop(uint32_t h);
+uint32_t swtimer_active(uint32_t h);
+uint32_t swtimer_missed(void);
+
+#endif // _SWTIMER_H
@@ -0,0 +1,57 @@
+/*
+ * File:   task_table.h
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+/* The tasks init_scheduler() starts with, as an X-macro list. There is no
+ * include guard: define TASK() and include this to expand each entry.
+ * The same list feeds the offline schedulability check (sim/sched_check),
+ * so it is the one place to describe a task.
+ *
+ *   TASK(fn, period, offset, wcet, chars)
+ *     fn      void fn(void), the task
+ *     period  ticks between releases
+ *     offset  extra ticks before the first release
+ *     wcet    worst case run, Timer 1 counts (1.3us). A budget for the task
+ *             on the 48MHz part: its run on the sim, scaled, with room to
+ *             spare. Check it against the P lines of a log from the target
+ *             (sched_check log). 0 if not known yet: then the scheduler
+ *             measures it, and sched_check fails unless a log gives it
+ *     chars   most debug print chars one release puts out
+ *
+ * Entries get handles 0, 1, 2 ... in order. */
+
+// turn on blink LED (about every second))
+TASK(task_blink_on, BLINK_PERIOD, 0, 20, 0)
+// turn it off again. task_blink_on retimes it every blink, to run once
+// some ticks later (the load shown), and it parks itself between. So it
+// really runs once per BLINK_PERIOD, which is what sched_check is given, at
+// a phase that moves: offset 1 is the soonest
+TASK(task_blink_off, BLINK_PERIOD, 1, 10, 0)
+
+#ifdef INCLUDE_TEST_TASKS
+// these tasks are for test/demo purposes. You can remove them if
+// not needed.
+
+// Start T2 which will raise an int and print something, every 10 secs
+// (the print is from the ISR, counted here)
+TASK(task_start_print_timer, 400, 0, 20, 8)
+// just print a boring message every two secs
+TASK(task_print_two_secs, 200, 0, 60, 24)
+// once, after 5 secs of profiling: re-phase the tasks to level the load
+// (the longest run here, a walk of the levelling window per task)
+TASK(task_level_load, 5 * SYSTEM_TICKS_PER_SEC, 0, 800, 24)
+#endif
+
+#ifdef PROFILE_TASKS
+// print the execution time of one task every second
+TASK(task_profile_dump, 200, 0, 150, 64)
+#endif
+
+#ifdef TICKLESS_IDLE
+// print wakeups/s and idle time every 10 secs
+TASK(task_idle_report, 10 * SYSTEM_TICKS_PER_SEC, 0, 60, 24)
+#endif
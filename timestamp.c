@@ -0,0 +1,63 @@
+/*
+ * File:   timestamp.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#include "timestamp.h"
+
+// the conversions below are exact only for whole numbers of cycles
+typedef char core_timer_whole_us[(CORE_TIMER_HZ % 1000000UL == 0) ? 1 : -1];
+typedef char core_timer_whole_tick_count[(CORE_TIMER_HZ % TICK_TIMER_HZ == 0) ? 1 : -1];
+
+#ifndef HAL_CORE_TIMER64
+
+/* The upper 31 bits of the timestamp, and bit 31 of Count when it was last
+ * read: (high << 1) | bit31. A reader that finds bit 31 gone from 1 to 0
+ * knows Count has wrapped since. It is one word, so it is always seen whole
+ * and is moved on with a compare and swap. If that fails someone else has
+ * just moved it on, which is as good. */
+static volatile uint32_t epoch = 0;
+
+void init_timestamp(void){
+    epoch = hal_core_timer() >> 31;
+}
+
+uint64_t timestamp_now(void){
+    uint32_t e = epoch;
+    uint32_t c = hal_core_timer();
+    uint32_t high = e >> 1;
+    uint32_t top = c >> 31;
+    if (top != (e & 1)){
+        if (!top){
+            high++; // wrapped
+        }
+        __sync_bool_compare_and_swap(&epoch, e, (high << 1) | top);
+    }
+    return ((uint64_t)high << 32) | c;
+}
+
+#else
+
+// the host simulation has a 64 bit core timer already
+
+void init_timestamp(void){
+}
+
+uint64_t timestamp_now(void){
+    return hal_core_timer64();
+}
+
+#endif // HAL_CORE_TIMER64
+
+uint64_t timestamp_to_ns(uint64_t t){
+    // in two parts, so that t * 10^9 cannot overflow
+    return (t / CORE_TIMER_HZ) * 1000000000ULL
+            + (t % CORE_TIMER_HZ) * 1000000000ULL / CORE_TIMER_HZ;
+}
+
+uint64_t timestamp_to_us(uint64_t t){
+    return t / (CORE_TIMER_HZ / 1000000UL);
+}
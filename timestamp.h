@@ -0,0 +1,43 @@
+/*
+ * File:   timestamp.h
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#ifndef _TIMESTAMP_H
+#define _TIMESTAMP_H
+
+#include "hal.h"
+#include "initialise.h"
+
+/* Timestamps from the CP0 Count register (the core timer), CORE_TIMER_HZ,
+ * which is SYSCLK_HZ / 2: 41.7ns a cycle with SYSCLK at 48MHz. Count is
+ * only 32 bits and wraps every 2^33 / SYSCLK_HZ (179s at 48MHz), so
+ * timestamp_now() carries it on to 64 bits in software. It can be called
+ * from tasks and ISR's of any level, without disabling interrupts, as long
+ * as something calls it at least every half wrap, 89s at 48MHz (Timer1Tick
+ * does, every tick).
+ *
+ * For a short interval, timestamp_now32() is just Count, one instruction,
+ * and the difference of two of them is right across a wrap. */
+
+// Timestamps are in core timer cycles from init_timestamp()
+#define TIMESTAMP_HZ CORE_TIMER_HZ
+
+// core timer cycles in one Timer 1 count (the unit of task WCET's)
+#define TIMESTAMP_PER_TICK_COUNT (CORE_TIMER_HZ / TICK_TIMER_HZ)
+
+void init_timestamp(void);
+uint64_t timestamp_now(void);
+#define timestamp_now32() hal_core_timer()
+
+uint64_t timestamp_to_ns(uint64_t t);
+uint64_t timestamp_to_us(uint64_t t);
+#define timestamp_from_us(us) ((uint64_t)(us) * (CORE_TIMER_HZ / 1000000UL))
+// rounded up, so a WCET is never under stated
+#define timestamp_to_tick_counts(t) \
+    (((t) + TIMESTAMP_PER_TICK_COUNT - 1) / TIMESTAMP_PER_TICK_COUNT)
+
+#endif // _TIMESTAMP_H
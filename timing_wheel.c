@@ -0,0 +1,66 @@
+/*
+ * File:   timing_wheel.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#include "timing_wheel.h"
+
+static wheel_mask wheel[WHEEL_SLOTS];
+static uint32_t release[WHEEL_MAX_ENTRIES];
+
+void wheel_init(void){
+    uint32_t i;
+    for (i = 0; i < WHEEL_SLOTS; i++){
+        wheel[i] = 0;
+    }
+}
+
+void wheel_insert(uint32_t id, uint32_t r){
+    release[id] = r;
+    wheel[r & WHEEL_MASK] |= (wheel_mask)1 << id;
+}
+
+void wheel_remove(uint32_t id){
+    wheel[release[id] & WHEEL_MASK] &= ~((wheel_mask)1 << id);
+}
+
+uint32_t wheel_release(uint32_t id){
+    return release[id];
+}
+
+wheel_mask wheel_take_due(uint32_t now){
+    /* Take every id due at tick now out of the wheel. Ids for a later lap
+     * stay where they are. */
+    wheel_mask * slot = &wheel[now & WHEEL_MASK];
+    wheel_mask m = *slot;
+    wheel_mask due = 0;
+    while (m){
+        uint32_t id = wheel_first(m);
+        m &= m - 1;
+        if (release[id] == now){
+            due |= (wheel_mask)1 << id;
+        }
+    }
+    *slot &= ~due;
+    return due;
+}
+
+uint32_t wheel_next_due(uint32_t now, uint32_t limit){
+    /* First tick from now on that has something due, looking no further
+     * than limit ticks (returns now + limit if nothing is due by then). */
+    uint32_t t;
+    for (t = now; t != now + limit; t++){
+        wheel_mask m = wheel[t & WHEEL_MASK];
+        while (m){
+            uint32_t id = wheel_first(m);
+            m &= m - 1;
+            if (release[id] == t){
+                return t;
+            }
+        }
+    }
+    return t;
+}
@@ -0,0 +1,39 @@
+/*
+ * File:   timing_wheel.h
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#ifndef _TIMING_WHEEL_H
+#define _TIMING_WHEEL_H
+
+#include <stdint.h>
+
+/* Hashed timing wheel of up to WHEEL_MAX_ENTRIES ids (task numbers). Each id
+ * has the absolute tick it is next due, and sits in slot (release &
+ * WHEEL_MASK) as one bit of that slot's mask. Each tick only the ids in one
+ * slot are looked at: the ones that are due, plus any that wrap round the
+ * wheel (period > WHEEL_SLOTS), which are passed over once a lap.
+ * Due ids come back as a mask, so they are taken lowest id first for free. */
+
+// must be 2^n
+#define WHEEL_SLOTS 64
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+
+// one bit per id
+#define WHEEL_MAX_ENTRIES 32
+typedef uint32_t wheel_mask;
+
+void wheel_init(void);
+void wheel_insert(uint32_t id, uint32_t release);
+void wheel_remove(uint32_t id);
+uint32_t wheel_release(uint32_t id);
+wheel_mask wheel_take_due(uint32_t now);
+uint32_t wheel_next_due(uint32_t now, uint32_t limit);
+
+// lowest id in a non empty mask
+#define wheel_first(m) ((uint32_t)__builtin_ctz(m))
+
+#endif // _TIMING_WHEEL_H
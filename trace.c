@@ -0,0 +1,125 @@
+/*
+ * File:   trace.c
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#include "trace.h"
+#include "timestamp.h"
+
+#ifdef TRACE_EVENTS
+
+#include "debug_uart.h"
+
+#define TRACE_MASK (TRACE_SIZE - 1)
+
+typedef struct {
+    uint8_t  type;          // 0 until the event is complete
+    uint8_t  id;
+    uint16_t arg;
+    uint32_t time;          // core timer
+} trace_record;
+
+static volatile trace_record trace_ring[TRACE_SIZE];
+static volatile uint32_t trace_head = 0;   // next event to reserve, not masked
+static volatile uint32_t trace_tail = 0;   // next event to send, not masked
+static volatile uint32_t lost = 0;
+static uint32_t lost_sent = 0;             // lost at the last TRACE_LOST frame
+
+void init_trace(void){
+    uint32_t i;
+    for (i = 0; i < TRACE_SIZE; i++){
+        trace_ring[i].type = 0;
+    }
+    trace_head = 0;
+    trace_tail = 0;
+    lost = 0;
+    lost_sent = 0;
+}
+
+void trace_event(uint32_t type, uint32_t id, uint32_t arg){
+    /* As debug_log_put(): reserve with compare and swap, so an ISR can
+     * trace in the middle of this, and hand over by writing type last. */
+    volatile trace_record * r;
+    uint32_t h, now = timestamp_now32();
+    do {
+        h = trace_head;
+        if (h - trace_tail >= TRACE_SIZE){
+            __sync_fetch_and_add(&lost, 1);
+            return; // ring is full
+        }
+    } while (!__sync_bool_compare_and_swap(&trace_head, h, h + 1));
+    r = &trace_ring[h & TRACE_MASK];
+    r->id = (uint8_t)id;
+    r->arg = (uint16_t)arg;
+    r->time = now;
+    __sync_synchronize();
+    r->type = (uint8_t)type;
+}
+
+static uint8_t * put_frame(uint8_t * p, uint32_t type, uint32_t id,
+                           uint32_t arg, uint32_t time){
+    uint32_t i;
+    uint8_t check = 0;
+    p[0] = TRACE_SYNC;
+    p[1] = (uint8_t)type;
+    p[2] = (uint8_t)id;
+    p[3] = (uint8_t)arg;
+    p[4] = (uint8_t)(arg >> 8);
+    p[5] = (uint8_t)time;
+    p[6] = (uint8_t)(time >> 8);
+    p[7] = (uint8_t)(time >> 16);
+    p[8] = (uint8_t)(time >> 24);
+    for (i = 1; i < TRACE_FRAME_SIZE - 1; i++){
+        check ^= p[i];
+    }
+    p[9] = check;
+    return p + TRACE_FRAME_SIZE;
+}
+
+void trace_drain(void){
+    /* Send up to TRACE_DRAIN_MAX complete events as one debug print
+     * message. Called from the main loop in dead time. They only leave the
+     * ring once the message is in the buffer; if there is no room they wait. */
+    uint8_t frames[TRACE_DRAIN_MAX * TRACE_FRAME_SIZE];
+    uint8_t * p = frames;
+    uint32_t t = trace_tail;
+    uint32_t n, room, l;
+    room = debug_print_free() / TRACE_FRAME_SIZE;
+    if (room > TRACE_DRAIN_MAX){
+        room = TRACE_DRAIN_MAX;
+    }
+    l = lost;
+    if (l != lost_sent && room){
+        p = put_frame(p, TRACE_LOST, 0, l - lost_sent, timestamp_now32());
+        room--;
+    }
+    for (n = 0; n < room && t != trace_head; n++, t++){
+        volatile trace_record * r = &trace_ring[t & TRACE_MASK];
+        if (r->type == 0){
+            break; // reserved, not written yet
+        }
+        p = put_frame(p, r->type, r->id, r->arg, r->time);
+    }
+    if (p == frames || !debug_buf_try_write(frames, p - frames)){
+        return;
+    }
+    lost_sent = l;
+    for (n = trace_tail; n != t; n++){
+        trace_ring[n & TRACE_MASK].type = 0;
+    }
+    __sync_synchronize();
+    trace_tail = t;
+}
+
+uint32_t trace_pending(void){
+    return (trace_tail != trace_head) || (lost != lost_sent);
+}
+
+uint32_t trace_lost(void){
+    return lost;
+}
+
+#endif // TRACE_EVENTS
@@ -0,0 +1,78 @@
+/*
+ * File:   trace.h
+ * Project : Cooperative scheduler for Digilent MAX32
+ * Author: Daniel McBrearty, McBee Audio Labs
+ * ( www.mcbeeaudio.com )
+ *
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "hal.h"
+
+/* Event trace, to see what happens inside a tick: which task ran when,
+ * which ISR's came in on top of it, and where debug print was lost because
+ * the drain did not get the time. Each event is a type, an id, a 16 bit
+ * argument and a core timer timestamp, put in a RAM ring in a few stores
+ * from tasks or ISR's of any level. trace_drain() sends them out over the
+ * debug UART in dead time, as binary frames between the text messages:
+ *
+ *   TRACE_SYNC type id arg(2) time(4) check      10 bytes, little endian
+ *
+ * check is the xor of the 8 bytes before it. TRACE_SYNC is 0, which the
+ * text never has. sim/trace_decode turns a capture into Chrome trace JSON
+ * (chrome://tracing, ui.perfetto.dev) or VCD (GTKWave). */
+
+// #define to build the trace points in. Left out, they compile to nothing.
+//#define TRACE_EVENTS
+
+// events in the ring, must be 2^n
+#define TRACE_SIZE 128
+// most events sent as one message by trace_drain()
+#define TRACE_DRAIN_MAX 8
+
+#define TRACE_SYNC          0
+#define TRACE_FRAME_SIZE    10
+
+// event types
+#define TRACE_TASK_START    1   // id = task handle, arg = tick
+#define TRACE_TASK_END      2   // id = task handle
+#define TRACE_ISR_ENTER     3   // id = TRACE_ISR_*
+#define TRACE_ISR_EXIT      4   // id = TRACE_ISR_*
+#define TRACE_FAST_START    5   // id = fast tier handle
+#define TRACE_FAST_END      6   // id = fast tier handle
+#define TRACE_LOG           7   // debug_log() record reserved, arg = record number
+#define TRACE_PRINT_DROP    8   // debug print message dropped, arg = chars
+#define TRACE_MARK          9   // trace_mark(id, arg)
+#define TRACE_LOST          10  // arg = events lost, the ring was full
+
+// ISR ids. The DMA ISR is not traced: sending its events would take
+// another transfer, and so on for ever.
+#define TRACE_ISR_TIMER1    1
+#define TRACE_ISR_TIMER2    2
+#define TRACE_ISR_TIMER3    3
+#define TRACE_ISR_UART1     4
+
+#ifdef TRACE_EVENTS
+
+void init_trace(void);
+void trace_event(uint32_t type, uint32_t id, uint32_t arg);
+void trace_drain(void);
+uint32_t trace_pending(void);
+uint32_t trace_lost(void);
+
+#else
+
+#define init_trace()
+#define trace_event(type, id, arg)
+#define trace_drain()
+#define trace_pending() 0
+#define trace_lost() 0
+
+#endif // TRACE_EVENTS
+
+// a user marker, from anywhere
+#define trace_mark(id, arg) trace_event(TRACE_MARK, (id), (arg))
+
+#endif // _TRACE_H
@@ -24,6 +24,10 @@
 #include <stdarg.h>
 void (*xfunc_out)(uint8_t);	/* Pointer to the output stream */
 static int8_t *outptr;
+#if _USE_XFUNC_BLOCK
+void (*xfunc_out_block)(const uint8_t*, uint32_t);	/* Pointer to the message output */
+static int8_t *outbuf;		/* Message staging buffer, 0: not staging */
+#endif
 
 /*----------------------------------------------*/
 /* Put a character                              */
@@ -35,6 +39,12 @@ void xputc (int8_t c)
 
 	if (outptr) {		/* Destination is memory */
 		*outptr++ = (uint8_t)c;
+#if _USE_XFUNC_BLOCK
+		if (outbuf && outptr == outbuf + _XFUNC_BLOCK_MAX) {	/* Staging buffer full? */
+			xfunc_out_block((const uint8_t*)outbuf, _XFUNC_BLOCK_MAX);
+			outptr = outbuf;
+		}
+#endif
 		return;
 	}
 	if (xfunc_out) {	/* Destination is device */
@@ -43,6 +53,44 @@ void xputc (int8_t c)
 }
 
 
+/* Put a run of characters with no '\n' in it. To memory or the staging
+   buffer it is copied in one go, not one xputc() per character. */
+static
+void xputn (
+	const int8_t* s,	/* Pointer to the characters */
+	uint32_t n			/* Number of characters */
+)
+{
+	uint32_t k;
+	int8_t *d;
+
+
+	if (!outptr) {		/* Destination is device */
+		if (xfunc_out) {
+			while (n--) xfunc_out((uint8_t)*s++);
+		}
+		return;
+	}
+	while (n) {
+		k = n; d = outptr;
+#if _USE_XFUNC_BLOCK
+		if (outbuf && k > (uint32_t)(outbuf + _XFUNC_BLOCK_MAX - d)) {	/* Fill the staging buffer */
+			k = outbuf + _XFUNC_BLOCK_MAX - d;
+		}
+#endif
+		n -= k;
+		while (k--) *d++ = *s++;
+		outptr = d;
+#if _USE_XFUNC_BLOCK
+		if (outbuf && d == outbuf + _XFUNC_BLOCK_MAX) {	/* Staging buffer full? */
+			xfunc_out_block((const uint8_t*)outbuf, _XFUNC_BLOCK_MAX);
+			outptr = outbuf;
+		}
+#endif
+	}
+}
+
+
 
 /*----------------------------------------------*/
 /* Put a null-terminated string                 */
@@ -52,8 +100,13 @@ void xputs (					/* Put a string to the default device */
 	const char* str				/* Pointer to the string */
 )
 {
+	const char *p;
+
+
 	while (*str) {
-		xputc(*str++);
+		for (p = str; *str && (!_CR_CRLF || *str != '\n'); str++) ;	/* Run up to a '\n' */
+		if (str != p) xputn((const int8_t*)p, str - p);
+		if (*str) xputc(*str++);
 	}
 }
 
@@ -79,6 +132,51 @@ void xfputs (					/* Put a string to the specified device */
 /*----------------------------------------------*/
 /* Formatted string output                      */
 /*----------------------------------------------*/
+
+/* Numbers up to 32 bits are converted with no divide: decimal two digits
+   at a time by a multiply with the reciprocal of 100, the others by shift
+   and mask. The M4K divider takes up to 35 cycles a go. */
+static const char dec2[] =
+	"00010203040506070809" "10111213141516171819" "20212223242526272829"
+	"30313233343536373839" "40414243444546474849" "50515253545556575859"
+	"60616263646566676869" "70717273747576777879" "80818283848586878889"
+	"90919293949596979899";
+static const char hexl[] = "0123456789abcdef";
+static const char hexu[] = "0123456789ABCDEF";
+
+uint32_t xnumeral (		/* Returns the index of the first digit */
+	int8_t* s,			/* Digit buffer, the digits go in from s[i - 1] down */
+	uint32_t i,			/* Index just past the last digit, at least 10 (non decimal stops at s[0]) */
+	uint32_t x,			/* Value */
+	uint32_t r,			/* Radix: 2, 8, 10 or 16 */
+	int8_t c			/* Type character, 'x' for lower case hex */
+)
+{
+	uint32_t j, k;
+	const int8_t *p;
+
+	if (r == 10) {
+		while (x >= 100) {
+			k = (uint32_t)(((uint64_t)x * 0x51EB851FUL) >> 37);	/* x / 100, exact for 32 bits */
+			j = (x - k * 100) * 2;
+			s[--i] = dec2[j + 1]; s[--i] = dec2[j];
+			x = k;
+		}
+		if (x >= 10) {
+			s[--i] = dec2[x * 2 + 1]; s[--i] = dec2[x * 2];
+		} else {
+			s[--i] = (int8_t)('0' + x);
+		}
+	} else {
+		j = (r == 16) ? 4 : (r == 8) ? 3 : 1;
+		p = (const int8_t*)((c == 'x') ? hexl : hexu);
+		do {
+			s[--i] = p[x & (r - 1)]; x >>= j;
+		} while (x != 0 && i != 0);
+	}
+	return i;
+}
+
 /*  xprintf("%d", 1234);			"1234"
     xprintf("%6d,%3d%%", -200, 5);	"  -200,  5%"
     xprintf("%-6u", 100);			"100   "
@@ -102,6 +200,7 @@ void xvprintf (
 {
 	uint32_t  r, i, j, w, f;
 	int8_t s[24], c, d, *p;
+	const char *q;
 #if _USE_LONGLONG
 	_LONGLONG_t v;
 	unsigned _LONGLONG_t vs;
@@ -112,6 +211,8 @@ void xvprintf (
 
 
 	for (;;) {
+		for (q = fmt; *fmt && *fmt != '%' && (!_CR_CRLF || *fmt != '\n'); fmt++) ;
+		if (fmt != q) xputn((const int8_t*)q, fmt - q);	/* Pass plain text through in one run */
 		c = *fmt++;					/* Get a format character */
 		if (!c) break;				/* End of format? */
 		if (c != '%') {				/* Pass it through if not a % sequense */
@@ -184,16 +285,20 @@ void xvprintf (
 		if (d == 'D' && v < 0) {	/* Negative value? */
 			v = 0 - v; f |= 16;
 		}
-		i = 0; vs = v;
-		do {
-			d = (char)(vs % r); vs /= r;
-			if (d > 9) d += (c == 'x') ? 0x27 : 0x07;
-			s[i++] = d + '0';
-		} while (vs != 0 && i < sizeof s);
-		if (f & 16) s[i++] = '-';
-		j = i; d = (f & 1) ? '0' : ' ';
+		i = sizeof s; vs = v;		/* Digits go in from the end, so they come out in order */
+		if (vs > 0xFFFFFFFFUL) {	/* Over 32 bits: divide */
+			do {
+				d = (char)(vs % r); vs /= r;
+				if (d > 9) d += (c == 'x') ? 0x27 : 0x07;
+				s[--i] = d + '0';
+			} while (vs != 0 && i != 0);
+		} else {
+			i = xnumeral(s, i, (uint32_t)vs, r, c);
+		}
+		if (f & 16) s[--i] = '-';
+		j = sizeof s - i; d = (f & 1) ? '0' : ' ';
 		while (!(f & 2) && j++ < w) xputc(d);
-		do xputc(s[--i]); while (i != 0);
+		xputn(&s[i], sizeof s - i);
 		while (j++ < w) xputc(' ');
 	}
 }
@@ -205,7 +310,21 @@ void xprintf (			/* Put a formatted string to the default device */
 )
 {
 	va_list arp;
-
+#if _USE_XFUNC_BLOCK
+	int8_t buf[_XFUNC_BLOCK_MAX], *pp, *pb;
+
+
+	if (xfunc_out_block) {	/* Stage the message and put it in one piece */
+		pp = outptr; pb = outbuf;	/* Save destination (nested call from an ISR) */
+		outbuf = outptr = buf;
+		va_start(arp, fmt);
+		xvprintf(fmt, arp);
+		va_end(arp);
+		if (outptr != buf) xfunc_out_block((const uint8_t*)buf, outptr - buf);
+		outptr = pp; outbuf = pb;	/* Restore destination */
+		return;
+	}
+#endif
 
 	va_start(arp, fmt);
 	xvprintf(fmt, arp);
@@ -220,8 +339,16 @@ void xsprintf (			/* Put a formatted string to the memory */
 )
 {
 	va_list arp;
+	int8_t *pp;
+#if _USE_XFUNC_BLOCK
+	int8_t *pb;
 
 
+	pb = outbuf;		/* Not staging a message */
+	outbuf = 0;
+#endif
+
+	pp = outptr;		/* Save destination (nested call from an ISR) */
 	outptr = buff;		/* Switch destination for memory */
 
 	va_start(arp, fmt);
@@ -229,7 +356,10 @@ void xsprintf (			/* Put a formatted string to the memory */
 	va_end(arp);
 
 	*outptr = 0;		/* Terminate output string with a \0 */
-	outptr = 0;			/* Switch destination for device */
+	outptr = pp;		/* Restore destination */
+#if _USE_XFUNC_BLOCK
+	outbuf = pb;
+#endif
 }
 
 
@@ -241,15 +371,19 @@ void xfprintf (					/* Put a formatted string to the specified device */
 {
 	va_list arp;
 	void (*pf)(uint8_t);
+	int8_t *pp;
 
 
 	pf = xfunc_out;		/* Save current output device */
 	xfunc_out = func;	/* Switch output to specified device */
+	pp = outptr;		/* Not to memory (nested call from an ISR) */
+	outptr = 0;
 
 	va_start(arp, fmt);
 	xvprintf(fmt, arp);
 	va_end(arp);
 
+	outptr = pp;
 	xfunc_out = pf;		/* Restore output device */
 }
 
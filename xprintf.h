@@ -8,6 +8,8 @@
 #include <stdint.h>
 
 #define _USE_XFUNC_OUT	1	/* 1: Use output functions */
+#define _USE_XFUNC_BLOCK	1	/* 1: xprintf() puts each message in one call to xfunc_out_block */
+#define _XFUNC_BLOCK_MAX	128	/* Staging buffer (on the stack), longer messages go in pieces */
 #define	_CR_CRLF		1	/* 1: Convert \n ==> \r\n in the output char */
 #define	_USE_LONGLONG	0	/* 1: Enable long long integer in type "ll". */
 #define	_LONGLONG_t		long long	/* Platform dependent long long integer type */
@@ -26,6 +28,11 @@ void xprintf (const char* fmt, ...);
 void xsprintf (char* buff, const char* fmt, ...);
 void xfprintf (void (*func)(uint8_t), const char*	fmt, ...);
 void put_dump (const void* buff, unsigned long addr, int32_t len, int32_t width);
+uint32_t xnumeral (int8_t* s, uint32_t i, uint32_t x, uint32_t r, int8_t c);
+#if _USE_XFUNC_BLOCK
+#define xdev_out_block(func) xfunc_out_block = (void(*)(const uint8_t*, uint32_t))(func)
+extern void (*xfunc_out_block)(const uint8_t*, uint32_t);
+#endif
 #define DW_CHAR		sizeof(char)
 #define DW_SHORT	sizeof(short)
 #define DW_LONG		sizeof(long)